@@ -11,50 +11,124 @@
   A recycling bin for the latter two categories serves as a cache, forming a fast path
 */
 
-// Alloc large blocks directly with mmap
-static void *yal_mmap(heap *hb,size_t len)
+// Alloc large blocks directly with mmap, or from recently released ones
+static void *yal_mmap(heap *hb,size_t len,bool clear)
 {
   size_t n = doalign(len,Page);
-  void *p = osmem(__LINE__,Falloc,hb,n,"block > mmap threshold");
+  void *p = mmap_cache_get(hb,n,&n);
   region *reg;
 
-  if (p == nil) return nil;
+  if (p) { // recycled
+    if (clear) zeroblk(hb,p,n);
+  } else { // fresh pages are zero
+    p = osmem(__LINE__,Falloc,hb,n,"block > mmap threshold");
+    if (p == nil) return nil;
+    atomic_fetch_add_explicit(&global_mapcnt,1,memory_order_relaxed);
+    ystatn(hb,mapuser,n)
+  }
+  ystat(hb,mmap)
+  ylat(hb,Yal_lat_mmap)
+  ystatn(hb,mmaplen,n)
 
-  reg = newregion(hb,p,len,0,Rmmap);
+  reg = newregion(hb,p,n,0,Rmmap);
   if (reg == nil) return nil;
   reg->clas = Noclass;
   reg->len = n;
   hb->lastreg = reg;
+  ytrace(Falloc,hb,Tmmap,n,p,reg->id)
   return p;
 }
 
+// grow or shrink an mmap block. Shrinking releases the tail pages, growing may move
 static void *mmap_realloc(heap *hb,region *reg,void *p,size_t orglen,size_t newlen)
 {
-  void *np = osmremap(p,orglen,newlen);
+  size_t nlen = doalign(newlen,Page);
+  void *np;
+
+  if (nlen == orglen) return p;
+  if (unlikely(hb->critical) && nlen < orglen) return p; // keep the tail until critical mode ends
+
+  if (oscritical(__LINE__,Falloc,hb,nlen,"mremap")) return nil;
+  np = osmremap(p,orglen,nlen);
+  ystat(hb,oscalls)
+  ylog(Falloc,"heap %u mremap %zu`b to %zu`b = %p",hb->id,orglen,nlen,np);
+  if (np == nil) return nil; // original block remains valid
+#if Yal_enable_prof
+  if (np != p && hb->profcnt) prof_free(hb,p);
+#endif
+  ystatn(hb,mapuser,nlen)
+  ystatdec(hb,mapuser,orglen)
+  ystatn(hb,mmaplen,nlen)
+  ystatdec(hb,mmaplen,orglen)
+
+  reg->len = nlen;
+  reg->user = np;
+  regdir_move(hb,reg,(size_t)p,orglen,(size_t)np,nlen);
+  return np;
+}
 
-  if (np) {
-    if (np != p) regdir(hb,nil,(size_t)p,orglen);
-    reg->len = newlen;
-    reg->user = np;
-    regdir(hb,reg,(size_t)np,newlen);
-  } else {
-    delregion(hb,reg);
+// grow an mmap block in place to cover ofs + len. Returns the new usable length from ofs, 0 if the pages above are taken
+static size_t mmap_expand(heap *hb,region *reg,size_t ofs,size_t len)
+{
+  size_t orglen = reg->len;
+  size_t nlen = doalign(ofs + len,Page);
+  void *p = reg->user;
+
+  if (nlen <= orglen) return orglen - ofs;
+  if (oscritical(__LINE__,Falloc,hb,nlen,"mremap")) return 0;
+  ystat(hb,oscalls)
+  if (osmremap_fixed(p,orglen,nlen) == nil) return 0;
+  ylog(Falloc,"heap %u expand mmap %p from %zu`b to %zu`b",hb->id,p,orglen,nlen);
+  ystatn(hb,mapuser,nlen)
+  ystatdec(hb,mapuser,orglen)
+  ystatn(hb,mmaplen,nlen)
+  ystatdec(hb,mmaplen,orglen)
+
+  reg->len = nlen;
+  regdir_move(hb,reg,(size_t)p,orglen,(size_t)p,nlen);
+  return nlen - ofs;
+}
+
+// move a page-aligned heap block into its own mmap region by remapping its pages instead of copying
+static void *mmap_promote(heap *hb,void *p,size_t orglen,size_t newlen)
+{
+  size_t nlen = doalign(newlen,Page);
+  void *np;
+  region *reg;
+
+  if ( ((size_t)p | orglen) & (Page - 1)) return nil;
+  if (oscritical(__LINE__,Falloc,hb,nlen,"mremap")) return nil;
+
+  np = osmremap_move(p,orglen,nlen);
+  ystatn(hb,oscalls,3)
+  ylog(Falloc,"heap %u promote %zu`b to mmap %zu`b = %p",hb->id,orglen,nlen,np);
+  if (np == nil) return nil;
+  atomic_fetch_add_explicit(&global_mapcnt,1,memory_order_relaxed);
+  ystatn(hb,mapuser,nlen)
+  ystat(hb,mmap)
+  ylat(hb,Yal_lat_mmap)
+  ystatn(hb,mmaplen,nlen)
+
+  reg = newregion(hb,np,nlen,0,Rmmap);
+  if (reg == nil) { // restore contents at the original place
+    memcpy(p,np,orglen);
+    osmunmap(np,nlen);
+    return nil;
   }
+  reg->clas = Noclass;
+  reg->len = nlen;
+  hb->lastreg = reg;
   return np;
 }
 
-static ub1 miniclas[8] = { 0,2,2,4, 4,8,8,8 };
+static ub1 miniclas[9] = { 0,2,2,4, 4,8,8,8, 8 };
 
-// main entry
-static void *yalloc_heap(heap *hb,size_t len,bool clear)
+// size class alen with index calen into len2tclas. Above Maxclasslen or without a class yet, fall back to buddy
+static void *yalloc_class(heap *hb,size_t len,ub4 alen,ub4 calen,bool clear)
 {
-  ub4 ord;
   ub4 e;
-  ub4 alen,calen;
   void *p;
-  char *cp;
-  region *reg,*newreg,**clasregs;
-  ub4 pos,posa,align;
+  region *reg = nil,*newreg,**clasregs;
   ub2 clas;
   ub2 tclas;
   ub2 clascnt,tclascnt;
@@ -62,23 +136,140 @@ static void *yalloc_heap(heap *hb,size_t len,bool clear)
   ub2 binmask;
   ub2 cnt;
 
+  // check size classes aka slabs, tentative at first for all sizes
+  tclas = hb->len2tclas[calen];
+  if (tclas == hi16 && (tclascnt = hb->tclascnt) < Maxtclass) {
+    tclas = hb->len2tclas[calen] = tclascnt;
+    ylog(Falloc,"new tclas %u for len %u,%u",tclas,alen,calen);
+    hb->tclas2len[tclas] = (ub2)calen;
+    hb->tclascnt = tclascnt + 1;
+  }
+
+  if (tclas != hi16) {
+    clas = hb->tclas2clas[tclas];
+    if (clas != hi16) {
+      if ( (binmask = hb->binmasks[clas]) ) { // check recycling bin
+        binp = hb->bins + clas * Bin;
+        e = ctz(binmask);
+        reg = binp[e].reg;
+        p = binp[e].p;
+        hb->binmasks[clas] = binmask & ~(1u << e);
+        ystat(hb,binhit)
+        ylat(hb,Yal_lat_bin)
+        ytrace(Falloc,hb,Tbin,len,p,reg->id)
+        if (clear) memset(p,0,len);
+        return p;
+      } // bin
+
+      clasregs = hb->clasreg + clas;
+      reg = *clasregs;
+      if (reg) {
+        if (reg->frecnt == 0) {
+          newreg = newslab(hb,alen,len);
+          if (newreg == nil) return nil;
+          newreg->clas = clas;
+          newreg->nxt = reg;
+          newreg->prv = reg->prv;
+          reg = newreg;
+          *clasregs = reg;
+        }
+      } else { // regions deleted earlier
+        reg = *clasregs = newslab(hb,alen,len);
+      }
+    } else if ( (clascnt = hb->clascnt) < Maxclass) { // no class yet, count
+      cnt = (hb->sizecount[tclas] + 1) & 0x7f;
+      hb->sizecount[tclas] = cnt;
+      ylog(Falloc,"tclas %u cnt %u",tclas,cnt);
+      if (cnt > Clas_threshold) { // new class
+        ylog(Falloc,"new clas %u for len %u,%u",clascnt,alen,calen);
+        hb->tclas2clas[tclas] = clas = clascnt;
+        hb->cal2clas[calen] = clas;
+        hb->clascnt = clascnt + 1;
+        reg = newslab(hb,alen,len);
+        if (reg == nil) return nil;
+        reg->clas = clas;
+        hb->clasreg[clas] = reg;
+      } // new class
+    } // no class
+    if (reg) return slab_alloc(hb,reg,clear);
+  }
+
+  // default to buddy
+  if (len < 1ul << Minorder) len = 1ul << Minorder;
+
+  p = buddy_alloc(hb,len,clear);
+  return p;
+}
+
+// common to all allocation entries: profile sampling and pending remote frees. 1 if this call is to be sampled
+static inline bool yalloc_pre(heap *hb,size_t len)
+{
+#if Yal_enable_prof
+  if (unlikely( (hb->profleft -= (sb8)len) < 0)) return 1;
+#endif
+
+  if (unlikely(atomic_load_explicit(&hb->remote,memory_order_relaxed) || atomic_load_explicit(&hb->remotetiny,memory_order_relaxed))) remote_drain(hb);
+  return 0;
+}
+
+// class index fixed at compile time, see Yal_sizeclass(). Bin or current slab, else the regular class path
+static void *yalloc_fixed(heap *hb,size_t len,ub4 calen)
+{
+  struct binentry *binp;
+  region *reg;
+  void *p;
+  ub4 e;
+  ub2 clas,binmask;
+
+  clas = hb->cal2clas[calen];
+  if (likely(clas != hi16)) {
+    if ( (binmask = hb->binmasks[clas]) ) {
+      binp = hb->bins + clas * Bin;
+      e = ctz(binmask);
+      reg = binp[e].reg;
+      p = binp[e].p;
+      hb->binmasks[clas] = binmask & ~(1u << e);
+      ystat(hb,binhit)
+      ylat(hb,Yal_lat_bin)
+      ytrace(Falloc,hb,Tbin,len,p,reg->id)
+      return p;
+    }
+    reg = hb->clasreg[clas];
+    if (reg && reg->frecnt) return slab_alloc(hb,reg,0);
+  }
+  return yalloc_class(hb,len,calen <= 16 ? calen : (calen - 16) << 4,calen,0);
+}
+
+// main entry
+static void *yalloc_heap(heap *hb,size_t len,bool clear)
+{
+  ub4 alen,calen;
+  void *p;
+  char *cp;
+  ub4 pos;
+
+  if (unlikely(yalloc_pre(hb,len))) return prof_alloc(hb,len,clear);
+
   len <<= guardbit;
-  reg = nil;
 
-  if (unlikely(len >= mmap_threshold)) return yal_mmap(hb,len);
+  if (unlikely(len >= mmap_limit(hb))) return yal_mmap(hb,len,clear);
 
   if (len < Maxclasslen) {
 
 #if 1
   // 'canned' initial bump allocator
-    pos = hb->inipos;
-    if (pos + len + 2 * Basealign <= Inimem) {
+    // blocks above 8 bytes are 16-aligned, as for slab cels, preceded by a 4-byte length header
+    pos = doalign(hb->inipos + 4,len > 8 ? 16u : Basealign);
+    alen = doalign(len,Basealign);
+    if (pos + alen <= Inimem) {
       cp = hb->inimem + pos;
-      *(ub4 *)cp = (ub4)len;
-      pos += Basealign;
-      alen = doalign(len,Basealign);
-      hb->inipos += alen + Basealign;
-      p = hb->inimem + pos;
+      *(ub4 *)(cp - 4) = (ub4)len;
+      hb->inipos = pos + alen;
+      hb->bumpcnt++;
+      p = cp;
+      ystat(hb,bump)
+      ylat(hb,Yal_lat_bump)
+      ytrace(Falloc,hb,Tbump,len,p,0)
       ylog(Falloc,"heap %u bump %u`b to %u`b = %p",hb->id,(ub4)len,hb->inipos,p);
       return p;
     }
@@ -93,59 +284,7 @@ static void *yalloc_heap(heap *hb,size_t len,bool clear)
       calen = (alen >> 4) + 16;
     }
 
-    // check size classes aka slabs, tentative at first for all sizes
-    tclas = hb->len2tclas[calen];
-    if (tclas == hi16 && (tclascnt = hb->tclascnt) < Maxtclass) {
-      tclas = hb->len2tclas[calen] = tclascnt;
-      ylog(Falloc,"new tclas %u for len %u,%u",tclas,alen,calen);
-      hb->tclas2len[tclas] = (ub2)calen;
-      hb->tclascnt = tclascnt + 1;
-    }
-
-    if (tclas != hi16) {
-      clas = hb->tclas2clas[tclas];
-      if (clas != hi16) {
-        if ( (binmask = hb->binmasks[clas]) ) { // check recycling bin
-          binp = hb->bins + clas * Bin;
-          e = ctz(binmask);
-          reg = binp[e].reg;
-          p = binp[e].p;
-          hb->binmasks[clas] = binmask & ~(1u << e);
-          if (clear) memset(p,0,len);
-          return p;
-        } // bin
-
-        clasregs = hb->clasreg + clas;
-        reg = *clasregs;
-        if (reg) {
-          if (reg->frecnt == 0) {
-            newreg = newslab(hb,alen,len);
-            if (newreg == nil) return nil;
-            newreg->clas = clas;
-            newreg->nxt = reg;
-            newreg->prv = reg->prv;
-            reg = newreg;
-            *clasregs = reg;
-          }
-        } else { // regions deleted earlier
-          reg = *clasregs = newslab(hb,alen,len);
-        }
-      } else if ( (clascnt = hb->clascnt) < Maxclass) { // no class yet, count
-        cnt = (hb->sizecount[tclas] + 1) & 0x7f;
-        hb->sizecount[tclas] = cnt;
-        ylog(Falloc,"tclas %u cnt %u",tclas,cnt);
-        if (cnt > Clas_threshold) { // new class
-          ylog(Falloc,"new clas %u for len %u,%u",clascnt,alen,calen);
-          hb->tclas2clas[tclas] = clas = clascnt;
-          hb->clascnt = clascnt + 1;
-          reg = newslab(hb,alen,len);
-          if (reg == nil) return nil;
-          reg->clas = clas;
-          hb->clasreg[clas] = reg;
-        } // new class
-      } // no class
-      if (reg) return slab_alloc(hb,reg,clear);
-    }
+    return yalloc_class(hb,len,alen,calen,clear);
   } // len < Maclass
 
   // default to buddy
@@ -155,77 +294,137 @@ static void *yalloc_heap(heap *hb,size_t len,bool clear)
   return p;
 }
 
+#if Yal_enable_latency
+static void latrec(heap *hb,ub8 t0)
+{
+  ub8 dt = ytsc() - t0;
+  ub4 b = dt ? 63 - clzl(dt) : 0;
+
+  if (b >= Yal_lat_buckets) b = Yal_lat_buckets - 1;
+  hb->lathist[hb->latpath][b]++;
+}
+#endif
+
+// Static bump memory for calls made while the thread's heap is being set up, e.g. from the os or libc. Never freed
+static char Align(16) bootmem[Bootmem];
+static _Atomic ub4 bootpos;
+static _Thread_local bool heap_setup;
+
+static bool isboot(const void *p)
+{
+  return (const char *)p >= bootmem && (const char *)p < bootmem + Bootmem;
+}
+
+static size_t bootlen(const void *p)
+{
+  return ((const ub4 *)p)[-1];
+}
+
+static void *bootalloc(size_t len)
+{
+  size_t alen = doalign(len,16u) + 16;
+  ub4 pos;
+
+  if (len >= Bootmem) return nil;
+  pos = atomic_fetch_add_explicit(&bootpos,(ub4)alen,memory_order_relaxed);
+  if (pos + alen > Bootmem) {
+    atomic_fetch_sub_explicit(&bootpos,(ub4)alen,memory_order_relaxed);
+    return oom(__LINE__,Falloc,len,1);
+  }
+  *(ub4 *)(bootmem + pos + 12) = (ub4)len;
+  ylog(Falloc,"boot alloc %zu`b at %u",len,pos);
+  return bootmem + pos + 16; // zeroed
+}
+
+static heap *setupheap(void)
+{
+  heap *hb;
+
+  if (heap_setup) return nil; // recursive
+  heap_setup = 1;
+  hb = getheap();
+  heap_setup = 0;
+  return hb;
+}
+
 // main entry
 static void *yalloc(size_t len,bool clear)
 {
-  void *p;
   heap *hb;
-  ub4 pos,posa,align;
-  static _Atomic ub4 nested;
-  static char tls[512];
 
   ylog(Falloc,"yalloc %zu`b%s",len,clear ? " zeroed" : "");
 
-  if  (atomic_fetch_add_explicit(&nested,1,memory_order_relaxed) > 5) {
-    // ylog(Falloc,"yalloc > %p",tls);
-    return tls;
+  hb = thread_heap;
+  if (unlikely(hb == nil || ((size_t)hb & 1))) {
+    if (heap_setup) return bootalloc(len);
+    hb = setupheap();
+    if (unlikely(hb == nil)) return nil;
   }
 
-#if 0
-  pos = atomic_fetch_add_explicit(&bootem_pos,len + Basealign,memory_order_relaxed);
-  atomic_fetch_add_explicit(&bootem_pos,hi16,memory_order_relaxed); // avoid overflow
-
-  if (pos + len + Basealign <= Inimem) {
-    align = get_align((ub4)len);
-    posa = doalign(pos,align);
-    p = bootmem + posa;
-    ylog(Falloc,"bump %u",(ub4)len);
-    return p;
-  }
+#if Yal_enable_latency
+  ub8 t0 = ytsc();
+  hb->latpath = 0;
+  void *p = yalloc_heap(hb,len,clear);
+  latrec(hb,t0);
+  return p;
+#else
+  return yalloc_heap(hb,len,clear);
 #endif
+}
 
-  // oswrite(2,"yalloc 1\n",9);
-  hb = getheap();
-  atomic_fetch_sub_explicit(&nested,1,memory_order_relaxed);
-  // oswrite(2,"yalloc 2\n",9);
-  if (unlikely(hb == nil)) return nil;
+// mmap block aligned by mapping align - Page extra, then unmapping the unaligned head and the tail
+static void *yal_mmap_align(heap *hb,size_t align,size_t len)
+{
+  size_t n = doalign(len,Page);
+  size_t xlen = n + align - Page;
+  size_t ip,ap;
+  char *p;
+  region *reg;
 
-  return yalloc_heap(hb,len,clear);
+  p = osmem(__LINE__,Falloc,hb,xlen,"aligned block > mmap threshold");
+  if (p == nil) return nil;
+  ip = (size_t)p;
+  ap = doalign(ip,align);
+  if (ap > ip) osunmem(__LINE__,Falloc,hb,p,ap - ip,"aligned block head");
+  if (ap + n < ip + xlen) osunmem(__LINE__,Falloc,hb,(void *)(ap + n),ip + xlen - ap - n,"aligned block tail");
+  atomic_fetch_add_explicit(&global_mapcnt,1,memory_order_relaxed);
+  ystatn(hb,mapuser,n)
+  ystat(hb,mmap)
+  ylat(hb,Yal_lat_mmap)
+  ystatn(hb,mmaplen,n)
+
+  reg = newregion(hb,(void *)ap,n,0,Rmmap);
+  if (reg == nil) return nil;
+  reg->clas = Noclass;
+  reg->len = n;
+  hb->lastreg = reg;
+  ytrace(Falloc,hb,Tmmap,n,(void *)ap,reg->id)
+  ylog(Falloc,"heap %u mmap %zu`b aligned %zu = %zx",hb->id,n,align,ap);
+  return (void *)ap;
 }
 
+/* Alignment is served natively, without over-allocation or offset pointers:
+   - up to 16 by the regular path: bump blocks and class cels above 8 bytes are 16-aligned, smaller ones to their class len
+   - slab cels of a multiple of align, as regions are page-aligned
+   - buddy blocks of at least align, being aligned to their size up to a page
+   - mmap blocks aligned by trimming an over-sized mapping, also for any len when align exceeds a page
+ */
 static void *yalloc_align(size_t align, size_t len)
 {
-  void *p,*ap;
-  ub4 alen;
   heap *hb;
-  region *reg;
-  size_t ip;
+  size_t alen;
 
-  if (len <= 8) alen = miniclas[len];
-  else alen = 16;
+  if (align & (align - 1)) align = 1ul << (64 - clzl(align)); // round up to pwr2
 
-  if (align <= alen) return yalloc(len,0);
+  if (align <= 16 && (len > 8 || align <= miniclas[len])) return yalloc(len,0); // see yalloc_heap() for the bump area
 
-  hb = getheap();
+  hb = setupheap();
   if (hb == nil) return nil;
 
-  len = max(len,align);
-  if (align > Page) len += align;
-  if (len > Mmap_threshold) {
-    if (align <= Page) return yalloc_heap(hb,len,0);
-    p = yalloc_heap(hb,len,0);
-    ip = (size_t)p;
-    ip = doalign(ip,align);
-    ap = (void *)ip;
-    reg = hb->lastreg;
-    reg->meta = ap;
-  }
-  p = buddy_alloc(hb,len,0);
-  if (p == nil) return p;
-  ip = (size_t)p;
-  ip = doalign(ip,align);
-  ap = (void *)ip;
-  reg = hb->lastreg;
-  buddy_addref(hb,reg,p,ap);
-  return ap;
+  if (align > Page) return yal_mmap_align(hb,align,len);
+
+  alen = doalign(len,align);
+  if (alen >= mmap_limit(hb)) return yal_mmap(hb,alen,0); // page-aligned
+  if (alen < Maxclasslen) return yalloc_class(hb,alen,(ub4)alen,alen <= 16 ? (ub4)alen : (ub4)(alen >> 4) + 16,0);
+  return buddy_alloc(hb,alen,0);
 }
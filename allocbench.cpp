@@ -0,0 +1,179 @@
+/* allocbench.cpp - node-based containers with yal::allocator and yal::memory_resource against std::allocator
+
+   This file is part of yalloc, yet another memory allocator with emphasis on efficiency and compactness.
+
+   SPDX-FileCopyrightText: © 2024 Joris van der Geer
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   usage: allocbench [-c] [-n ops]
+   -c  - csv output, same columns as bench
+   -n  - elements per case, default 1M
+
+   Linked with the symbol-prefixed yalloc_p.o, thus std::allocator uses the system allocator in the same binary.
+   Columns 'alloc' are std, yal for yal::allocator and pmr for std::pmr containers on yal::memory_resource.
+*/
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory_resource>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include "yalloc.hpp"
+
+static int csv;
+
+typedef std::uint64_t ub8;
+
+static ub8 nsnow()
+{
+  return (ub8)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void report(const char *name,const char *cas,std::size_t arg,std::size_t ops,ub8 ns)
+{
+  double nsop = ops ? (double)ns / (double)ops : 0;
+  double opsec = ns ? (double)ops * 1e9 / (double)ns : 0;
+
+  if (csv) std::printf("%s,%s,%zu,%zu,%lu,%.2f,%.0f\n",name,cas,arg,ops,(unsigned long)ns,nsop,opsec);
+  else std::printf("%-8s %-16s %9zu %10zu ops %9.2f ns/op %9.2f Mop/s\n",name,cas,arg,ops,nsop,opsec / 1e6);
+  std::fflush(stdout);
+}
+
+static ub8 xrand(ub8 &x)
+{
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return x;
+}
+
+// container types per allocator flavour
+struct stdkind {
+  static constexpr const char *name = "std";
+  template <class T> using alloc = std::allocator<T>;
+  template <class T> static alloc<T> make() { return alloc<T>(); }
+};
+
+struct yalkind {
+  static constexpr const char *name = "yal";
+  template <class T> using alloc = yal::allocator<T>;
+  template <class T> static alloc<T> make() { return alloc<T>(); }
+};
+
+struct pmrkind {
+  static constexpr const char *name = "pmr";
+  template <class T> using alloc = std::pmr::polymorphic_allocator<T>;
+  template <class T> static alloc<T> make() { return alloc<T>(yal::resource()); }
+};
+
+template <class K> static void bench_map(std::size_t n)
+{
+  typedef std::pair<const ub8,ub8> V;
+  std::map<ub8,ub8,std::less<ub8>,typename K::template alloc<V>> m(K::template make<V>());
+  ub8 rnd = 1,sum = 0;
+  ub8 t0;
+  std::size_t i;
+
+  t0 = nsnow();
+  for (i = 0; i < n; i++) m.emplace(xrand(rnd),i);
+  report(K::name,"map insert",n,n,nsnow() - t0);
+
+  rnd = 1;
+  t0 = nsnow();
+  for (i = 0; i < n; i++) sum += m.find(xrand(rnd))->second;
+  report(K::name,"map find",n,n,nsnow() - t0);
+
+  rnd = 1;
+  t0 = nsnow();
+  for (i = 0; i < n; i++) m.erase(xrand(rnd));
+  report(K::name,"map erase",n,n,nsnow() - t0);
+  if (sum == 1) std::printf(" ");
+}
+
+// fixed population, random replacement
+template <class K> static void bench_set_churn(std::size_t n)
+{
+  std::set<ub8,std::less<ub8>,typename K::template alloc<ub8>> s(K::template make<ub8>());
+  std::vector<ub8> keys(65536);
+  ub8 rnd = 7;
+  ub8 t0;
+  std::size_t i,k;
+
+  for (i = 0; i < keys.size(); i++) s.insert(keys[i] = xrand(rnd));
+
+  t0 = nsnow();
+  for (i = 0; i < n; i++) {
+    k = xrand(rnd) & (keys.size() - 1);
+    s.erase(keys[k]);
+    s.insert(keys[k] = xrand(rnd));
+  }
+  report(K::name,"set churn",keys.size(),n,nsnow() - t0);
+}
+
+template <class K> static void bench_list(std::size_t n)
+{
+  std::list<ub8,typename K::template alloc<ub8>> l(K::template make<ub8>());
+  ub8 t0;
+  std::size_t i;
+
+  t0 = nsnow();
+  for (i = 0; i < n; i++) {
+    l.push_back(i);
+    if (i & 1) l.pop_front();
+  }
+  l.clear();
+  report(K::name,"list fifo",n,n,nsnow() - t0);
+}
+
+template <class K> static void bench_umap(std::size_t n)
+{
+  typedef std::pair<const ub8,ub8> V;
+  std::unordered_map<ub8,ub8,std::hash<ub8>,std::equal_to<ub8>,typename K::template alloc<V>> m(K::template make<V>());
+  ub8 rnd = 3;
+  ub8 t0;
+  std::size_t i;
+
+  t0 = nsnow();
+  for (i = 0; i < n; i++) m.emplace(xrand(rnd),i);
+  report(K::name,"umap insert",n,n,nsnow() - t0);
+
+  rnd = 3;
+  t0 = nsnow();
+  for (i = 0; i < n; i++) m.erase(xrand(rnd));
+  report(K::name,"umap erase",n,n,nsnow() - t0);
+}
+
+template <class K> static void run(std::size_t n)
+{
+  bench_map<K>(n);
+  bench_set_churn<K>(n);
+  bench_list<K>(n);
+  bench_umap<K>(n);
+}
+
+int main(int argc,char *argv[])
+{
+  std::size_t n = 1000000;
+
+  while (argc > 1 && argv[1][0] == '-') {
+    if (std::strcmp(argv[1],"-c") == 0) csv = 1;
+    else if (std::strcmp(argv[1],"-n") == 0 && argc > 2) { n = std::strtoul(argv[2],nullptr,10); argc--; argv++; }
+    else { std::fprintf(stderr,"usage: allocbench [-c] [-n ops]\n"); return 1; }
+    argc--; argv++;
+  }
+
+  if (csv) std::printf("alloc,case,arg,ops,ns,ns_per_op,ops_per_sec\n");
+
+  run<stdkind>(n);
+  run<yalkind>(n);
+  run<pmrkind>(n);
+  return 0;
+}
@@ -150,6 +150,8 @@ typedef const char cchar;
  #define Mallike __attribute__ ((malloc))
  #define _Printf(fmt,ap) __attribute__ ((format (printf,fmt,ap)))
  #define Unused __attribute__ ((unused))
+ #define Noinline __attribute__ ((noinline))
+ #define Destructor __attribute__ ((destructor))
  #define Align(a) __attribute__ ((aligned (a)))
  #define likely(a) __builtin_expect_with_probability( (a),1,0.999)
  #define unlikely(a) __builtin_expect_with_probability( (a),1,0.001)
@@ -166,6 +168,8 @@ typedef const char cchar;
  #define Inline inline
  #define Mallike
  #define Unused
+ #define Noinline
+ #define Destructor
  #define Align(a)
  #define _Printf(fmt,ap)
 #endif
@@ -194,7 +198,7 @@ typedef const char cchar;
   typedef __int128_t sb16;
 #endif
 
-#define doalign(p,n) ( (p) + (n) - 1) & ~((n) - 1)
+#define doalign(p,n) ( ( (p) + (n) - 1) & ~((n) - 1) )
 
 #if defined _FORTIFY_SOURCE && _FORTIFY_SOURCE > 0
   // #warning "_FORTIFY_SOURCE is defined"
@@ -0,0 +1,312 @@
+/* bench.c - microbenchmarks per allocation path, yalloc against the system allocator
+
+   This file is part of yalloc, yet another memory allocator with emphasis on efficiency and compactness.
+
+   SPDX-FileCopyrightText: © 2024 Joris van der Geer
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   usage: bench [-c] [-a yalloc|libc] [-n ops] [case ...]
+   -c  - csv output
+   -a  - only run given allocator
+   -n  - ops per case, default 1M
+
+   Each case is isolated to exercise one yalloc path. Cases marked 'pair' count a malloc + free as one op.
+*/
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "base.h"
+
+#include "bench.h"
+
+static int csv;
+
+static void report(const struct allocator *ap,cchar *cas,size_t arg,size_t ops,ub8 ns)
+{
+  double nsop = ops ? (double)ns / (double)ops : 0;
+  double opsec = ns ? (double)ops * 1e9 / (double)ns : 0;
+
+  if (csv) printf("%s,%s,%zu,%zu,%lu,%.2f,%.0f\n",ap->name,cas,arg,ops,ns,nsop,opsec);
+  else printf("%-8s %-12s %9zu %10zu ops %9.2f ns/op %9.2f Mop/s\n",ap->name,cas,arg,ops,nsop,opsec / 1e6);
+  fflush(stdout);
+}
+
+// -- cases --
+
+// first allocations of a new thread are served from the heap's bump area
+#define Bumpcnt 32
+
+struct bumparg {
+  const struct allocator *ap;
+  size_t len;
+  ub8 ns;
+};
+
+static void *bump_thread(void *arg)
+{
+  struct bumparg *bp = arg;
+  const struct allocator *ap = bp->ap;
+  void *ptrs[Bumpcnt];
+  ub8 t0;
+  ub4 i;
+
+  t0 = nsnow();
+  for (i = 0; i < Bumpcnt; i++) ptrs[i] = ap->malloc(bp->len);
+  bp->ns += nsnow() - t0;
+
+  for (i = 0; i < Bumpcnt; i++) ap->free(ptrs[i]);
+  return nil;
+}
+
+static void bench_bump(const struct allocator *ap,size_t ops)
+{
+  struct bumparg ba;
+  pthread_t tid;
+  size_t n,rounds = max(ops / (Bumpcnt * 64),16);
+
+  ba.ap = ap;
+  ba.len = 16;
+  ba.ns = 0;
+  for (n = 0; n < rounds; n++) {
+    if (pthread_create(&tid,nil,bump_thread,&ba)) { fprintf(stderr,"cannot create thread: %m\n"); return; }
+    pthread_join(tid,nil);
+  }
+  report(ap,"bump",ba.len,rounds * Bumpcnt,ba.ns);
+}
+
+// malloc + free of the same size hits the recycling bin once a size class exists
+static void bench_bin(const struct allocator *ap,size_t ops)
+{
+  size_t len,i;
+  void *p;
+  ub8 t0;
+
+  for (len = 16; len <= 2048; len <<= 1) {
+    for (i = 0; i < 256; i++) { p = ap->malloc(len); sink = p; ap->free(p); } // create class
+    t0 = nsnow();
+    for (i = 0; i < ops; i++) {
+      p = ap->malloc(len);
+      sink = p;
+      ap->free(p);
+    }
+    report(ap,"bin pair",len,ops,nsnow() - t0);
+  }
+}
+
+// sequential allocations from a fresh slab take the fast path, refilling holes takes the search path
+static void bench_slab(const struct allocator *ap,size_t ops)
+{
+  void **ptrs = calloc(ops,sizeof(void *));
+  size_t len = 64;
+  size_t i,n;
+  ub8 t0;
+
+  if (ptrs == nil) return;
+
+  t0 = nsnow();
+  for (i = 0; i < ops; i++) ptrs[i] = ap->malloc(len);
+  report(ap,"slab fast",len,ops,nsnow() - t0);
+
+  for (i = 0; i < ops; i += 2) ap->free(ptrs[i]);
+
+  n = 0;
+  t0 = nsnow();
+  for (i = 0; i < ops; i += 2) { ptrs[i] = ap->malloc(len); n++; }
+  report(ap,"slab search",len,n,nsnow() - t0);
+
+  for (i = 0; i < ops; i++) ap->free(ptrs[i]);
+  free(ptrs);
+}
+
+// above the largest size class. An anchor block keeps the region alive
+static void bench_buddy(const struct allocator *ap,size_t ops)
+{
+  void *anchor,*p;
+  size_t len,i,n;
+  ub4 ord;
+  ub8 t0;
+
+  for (ord = 13; ord <= 23; ord++) {
+    len = 1ul << ord;
+    n = max(ops >> (ord - 10),1000);
+    anchor = ap->malloc(len);
+    t0 = nsnow();
+    for (i = 0; i < n; i++) {
+      p = ap->malloc(len);
+      sink = p;
+      ap->free(p);
+    }
+    report(ap,"buddy pair",len,n,nsnow() - t0);
+    ap->free(anchor);
+  }
+}
+
+// above the mmap threshold, first page touched
+static void bench_mmap(const struct allocator *ap,size_t ops)
+{
+  size_t len,i,n = max(ops >> 10,100);
+  char *p;
+  ub8 t0;
+
+  for (len = 32ul << 20; len <= 128ul << 20; len <<= 1) {
+    t0 = nsnow();
+    for (i = 0; i < n; i++) {
+      p = ap->malloc(len);
+      if (p == nil) break;
+      *p = 1;
+      ap->free(p);
+    }
+    report(ap,"mmap pair",len,i,nsnow() - t0);
+  }
+}
+
+// grow by 1.5x from 16 bytes up to the given size
+static void bench_realloc(const struct allocator *ap,size_t ops)
+{
+  size_t len,top,n = 0;
+  char *p,*np;
+  ub8 t0;
+
+  for (top = 4096; top <= 16ul << 20; top <<= 6) {
+    n = 0;
+    t0 = nsnow();
+    while (n < ops) {
+      p = ap->malloc(16);
+      for (len = 16; len < top; len += (len >> 1)) {
+        np = ap->realloc(p,len);
+        if (np == nil) break;
+        p = np;
+        p[len - 1] = 1;
+        n++;
+      }
+      ap->free(p);
+    }
+    report(ap,"realloc",top,n,nsnow() - t0);
+    ops >>= 3;
+  }
+}
+
+static void bench_calloc(const struct allocator *ap,size_t ops)
+{
+  size_t len,i,n;
+  void *p;
+  ub8 t0;
+
+  for (len = 64; len <= 1ul << 20; len <<= 4) {
+    n = max(ops / (len >> 6),1000);
+    t0 = nsnow();
+    for (i = 0; i < n; i++) {
+      p = ap->calloc(1,len);
+      sink = p;
+      ap->free(p);
+    }
+    report(ap,"calloc pair",len,n,nsnow() - t0);
+  }
+}
+
+static void bench_aligned(const struct allocator *ap,size_t ops)
+{
+  size_t align,i;
+  void *p;
+  ub8 t0;
+
+  for (align = 64; align <= 65536; align <<= 5) {
+    t0 = nsnow();
+    for (i = 0; i < ops; i++) {
+      p = ap->aligned_alloc(align,256);
+      sink = p;
+      ap->free(p);
+    }
+    report(ap,"aligned pair",align,ops,nsnow() - t0);
+  }
+}
+
+// block copy and zero fill kernels, from in-cache to well above the last-level cache size
+static void bench_copy(const struct allocator *ap,size_t ops)
+{
+  size_t len,i,n;
+  char *src,*dst;
+  ub8 t0;
+
+  for (len = 1ul << 16; len <= 1ul << 26; len <<= 2) {
+    src = malloc(len);
+    dst = malloc(len);
+    if (src == nil || dst == nil) break;
+    memset(src,1,len);
+    memset(dst,2,len);
+    n = max(ops / (len >> 10),16);
+    t0 = nsnow();
+    for (i = 0; i < n; i++) ap->copy(dst,src,len);
+    sink = dst;
+    report(ap,"copy",len,n,nsnow() - t0);
+
+    t0 = nsnow();
+    for (i = 0; i < n; i++) ap->zero(dst,len);
+    sink = dst;
+    report(ap,"fill",len,n,nsnow() - t0);
+    free(src);
+    free(dst);
+  }
+}
+
+static const struct bcase {
+  cchar *name;
+  void (*fn)(const struct allocator *ap,size_t ops);
+} cases[] = {
+  { "bump",bench_bump },
+  { "bin",bench_bin },
+  { "slab",bench_slab },
+  { "buddy",bench_buddy },
+  { "mmap",bench_mmap },
+  { "realloc",bench_realloc },
+  { "calloc",bench_calloc },
+  { "aligned",bench_aligned },
+  { "copy",bench_copy }
+};
+
+#define Ccnt (sizeof(cases) / sizeof(cases[0]))
+
+static int usage(void)
+{
+  ub4 c;
+
+  fprintf(stderr,"usage: bench [-c] [-a yalloc|libc] [-n ops] [case ...]\ncases:");
+  for (c = 0; c < Ccnt; c++) fprintf(stderr," %s",cases[c].name);
+  fprintf(stderr,"\n");
+  return 1;
+}
+
+int main(int argc,char *argv[])
+{
+  cchar *only = nil;
+  size_t ops = 1000000;
+  ub4 a,c;
+  int i,sel;
+
+  while (argc > 1 && argv[1][0] == '-') {
+    if (strcmp(argv[1],"-c") == 0) csv = 1;
+    else if (strcmp(argv[1],"-a") == 0 && argc > 2) { only = argv[2]; argc--; argv++; }
+    else if (strcmp(argv[1],"-n") == 0 && argc > 2) { ops = strtoul(argv[2],nil,10); argc--; argv++; }
+    else return usage();
+    argc--; argv++;
+  }
+  if (ops < 64) return usage();
+
+  if (csv) printf("alloc,case,arg,ops,ns,ns_per_op,ops_per_sec\n");
+
+  for (c = 0; c < Ccnt; c++) {
+    sel = argc < 2;
+    for (i = 1; i < argc; i++) if (strcmp(argv[i],cases[c].name) == 0) sel = 1;
+    if (sel == 0) continue;
+    for (a = 0; a < Acnt; a++) {
+      if (only && strcmp(only,allocators[a].name)) continue;
+      cases[c].fn(allocators + a,ops);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,43 @@
+/* bench.h - allocators and timing for the benchmarks
+
+   This file is part of yalloc, yet another memory allocator with emphasis on efficiency and compactness.
+
+   SPDX-FileCopyrightText: © 2024 Joris van der Geer
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   Benchmarks link against a -DYal_prefix build of yalloc, thus both allocators run in the same process.
+*/
+
+#define Yal_prefix
+#include "yalloc.h"
+
+struct allocator {
+  cchar *name;
+  void *(*malloc)(size_t n);
+  void (*free)(void *p);
+  void *(*calloc)(size_t count,size_t size);
+  void *(*realloc)(void *p,size_t newlen);
+  void *(*aligned_alloc)(size_t align,size_t size);
+  void (*copy)(void *dst,const void *src,size_t len); // as used for realloc and calloc
+  void (*zero)(void *p,size_t len);
+};
+
+static void libc_copy(void *dst,const void *src,size_t len) { memcpy(dst,src,len); }
+static void libc_zero(void *p,size_t len) { memset(p,0,len); }
+
+static const struct allocator allocators[] = {
+  { "yalloc",yal_malloc,yal_free,yal_calloc,yal_realloc,yal_aligned_alloc,yal_copy,yal_zero },
+  { "libc",malloc,free,calloc,realloc,aligned_alloc,libc_copy,libc_zero }
+};
+
+#define Acnt (sizeof(allocators) / sizeof(allocators[0]))
+
+static void *volatile sink; // keeps the compiler from eliding malloc/free pairs
+
+static ub8 nsnow(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return (ub8)ts.tv_sec * 1000000000ul + (ub8)ts.tv_nsec;
+}
@@ -79,18 +79,36 @@
   free() uses the region directory to determine the region and the order to find the size and thus cell.
 */
 
-static ub4 admlens[Maxorder]; // todo
+#define Buddy_minord 12 // order map granule, as buddy blocks start at Maxclasslen
+#define Buddy_sumlen ((Maxorder + 1) * sizeof(ub4))
+
+// admin: free counts per order, followed by a 1-byte order map per granule
+static ub1 *buddy_ordline(region *reg)
+{
+  return (ub1 *)reg->meta + Buddy_sumlen;
+}
 
 static region *newbuddy(heap *hb,ub4 order)
 {
   // ub2 ordlo= max(Minorder,order - min(order,Orderrange));
   size_t len = 1UL << order;
-  ub4 admlen = admlens[order];
+  size_t admlen = Buddy_sumlen + (1ul << (order - min(order,Buddy_minord)));
   region *reg = newregion(hb,nil,len,admlen,Rbuddy);
 
+  sassert((1u << Buddy_minord) == Maxclasslen,"buddy granule matches Maxclasslen");
+
+  if (reg) reg->minorder = (ub1)min(order,Buddy_minord);
   return reg;
 }
 
+// record the order of an allocated block for free() and realloc(). len is a power of two
+static void buddy_setord(region *reg,void *p,uint32_t len)
+{
+  size_t ofs = ((size_t)p - (size_t)reg->user) >> reg->minorder;
+
+  buddy_ordline(reg)[ofs] = (ub1)min(ctz(len),reg->order);
+}
+
 // body of buddy alloc
 static void *buddy_allocreg(heap *hb,region *reg,uint32_t len,ub4 ord,ub4 alord,bool clear)
 {
@@ -100,10 +118,12 @@ static void *buddy_allocreg(heap *hb,region *reg,uint32_t len,ub4 ord,ub4 alord,
   // ub2 order = reg->order;
 
   sums[alord]--;
+  buddy_setord(reg,user,len);
 
   ylog(Fbuddy,"heap %u reg %u len %u ord %u",hb->id,reg->id,len,ord);
+  ytrace(Fbuddy,hb,Tbuddy,len,user,reg->id)
 
-  if (clear) memset(user,0,len);
+  regclear(hb,reg,user,len,clear);
   return user;
 }
 
@@ -113,32 +133,45 @@ static void *buddy_allocfixreg(heap *hb,region *reg,uint32_t len,ub4 ord,bool cl
   // ub8 *meta = reg->meta;
   void *user = reg->user;
 
+  buddy_setord(reg,user,len);
   ylog(Fbuddy,"heap %u reg %u len %u ord %u",hb->id,reg->id,len,ord);
-  if (clear) memset(user,0,len);
+  ytrace(Fbuddy,hb,Tbuddy,len,user,reg->id)
+  regclear(hb,reg,user,len,clear);
   return user;
 }
 
+// new region serving blocks of given order
+static region *buddy_newreg(heap *hb,ub4 ord)
+{
+  ub4 order = max(newregorder(hb),ord);
+  region *reg = newbuddy(hb,order);
+
+  if (reg == nil) return nil;
+  reg->clas = Noclass;
+  hb->buddies[ord - Minorder] = reg;
+  hb->buddymask |= (1u << ord);
+  return reg;
+}
+
 static void *buddy_alloc(heap *hb,size_t slen,bool clear)
 {
   region *reg;
   uint32_t mask = hb->buddymask;
-  ub4 ord,alord,order;
+  ub4 ord,alord;
 
   uint32_t len = (uint32_t)slen & ((1u << Maxorder) - 1);
 
+  ystat(hb,buddy)
+  ylat(hb,Yal_lat_buddy)
   ord = 32u - clz(len);
   ylog(Fbuddy,"buddy alloc len %u` ord %u %u mask %x",len,ord,clz(len),mask);
   if (len & (len-1)) len = 1U << (++ord);
 
   // ylog(Fbuddy,"buddy alloc len %u` ord %u mask %x",len,ord,mask);
   if ( (mask & (len - 1)) == 0 ) { // no space
-    order = max(newregorder(hb),ord);
-    reg = newbuddy(hb,order);
+    reg = buddy_newreg(hb,ord);
     if (reg == nil) return nil;
-    reg->clas = Noclass;
     alord = ord;
-    hb->buddies[ord - Minorder] = reg;
-    hb->buddymask |= (1u << ord);
   } else {
     if (mask & len) {
       reg = hb->buddies[ord];
@@ -150,14 +183,19 @@ static void *buddy_alloc(heap *hb,size_t slen,bool clear)
   return buddy_allocreg(hb,reg,len,ord,alord,clear);
 }
 
-static void *buddy_realloc(heap *hb,region *reg,void *p,size_t newlen)
+// block length from the order map, as recorded by buddy_setord()
+static size_t buddy_len(region *reg,size_t ip)
 {
-  return p;
+  uint32_t ofs = (uint32_t)(ip - (size_t)reg->user) >> reg->minorder;
+
+  return 1ul << buddy_ordline(reg)[ofs];
 }
 
-// make ap being recognised as link from p
-static void buddy_addref(heap *hb,region *reg,void *p,void *ap)
+// in-place if it fits, nil otherwise
+static void *buddy_realloc(heap *hb,region *reg,void *p,size_t newlen)
 {
+  if (newlen <= buddy_len(reg,(size_t)p)) return p;
+  return nil;
 }
 
 static bool buddy_free(heap *hb,region *reg,size_t ip)
@@ -168,12 +206,11 @@ static bool buddy_free(heap *hb,region *reg,size_t ip)
   ub4 ord;
   ub4 order = reg->order;
   ub4 minord = reg->minorder;
-  ub4 ordrng = order - minord;
   uint64_t smask = reg->smask;
   uint32_t ofs = (uint32_t)(ip - (size_t)user) >> minord;
   ub4 cntord;
 
-  ub1 *ordline = (ub1 *)(meta + ordrng);
+  ub1 *ordline = buddy_ordline(reg);
 
   ord = ordline[ofs];
 
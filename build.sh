@@ -11,6 +11,7 @@ dbg=0
 case $tool in
   'clang')
   cc=clang
+  cxx=clang++
   cdiag='-Weverything -Wimplicit-int-conversion -Wunused -Wsign-conversion -Wno-padded -Wno-char-subscripts -Werror=format -Wno-c2x-compat'
   cfmt='-fno-caret-diagnostics -fno-color-diagnostics -fno-diagnostics-show-option -fno-diagnostics-fixit-info -fno-diagnostics-show-note-include-stack -std=c11 -funsigned-char'
   cxtra='-funsigned-char -fno-builtin-malloc -fno-builtin-calloc -fno-builtin-realloc -fno-builtin-free -ftls-model=local-exec'
@@ -26,6 +27,7 @@ case $tool in
 
   'gcc')
   cc=gcc-13
+  cxx=g++-13
   cdiag='-Wall -Wextra -Wshadow -Wundef -Wno-unused -Wno-padded -Wno-char-subscripts -Werror -Wstack-usage=35000'
   cfmt='-fmax-errors=60 -fno-diagnostics-show-caret -fno-diagnostics-show-option -fno-diagnostics-color -fcompare-debug-second'
   cxtra='-funsigned-char -fno-builtin-malloc -fno-builtin-calloc -fno-builtin-realloc -fno-builtin-free -ftls-model=local-exec'
@@ -40,7 +42,7 @@ case $tool in
   ;;
 esac
 
-copt='-O2 -march=native'
+copt='-O2 -march=native -fno-omit-frame-pointer' # frame pointers for heap profiler backtraces
 
 cflags="$copt $cdiag $cfmt $cdbg $cxtra"
 
@@ -153,7 +155,7 @@ while [ $# -ge 1 ]; do
   shift
 done
 
-#cc printf.o printf.c base.h printf.h
+cc printf.o printf.c base.h printf.h
 
 if [ $dogen -eq 1 ]; then
   cc genadm.o genadm.c base.h printf.h config.h stdio.h
@@ -165,13 +167,44 @@ fi
 
 # cat dir.h
 
-cc yalloc.o yalloc.c alloc.h base.h buddy.h config.h diag.h heap.h os.h std.h printf.h region.h slab.h
+cc yalloc.o yalloc.c alloc.h base.h buddy.h conf.h config.h diag.h frag.h globdir.h heap.h mmap.h numa.h os.h std.h printf.h prof.h region.h reserve.h slab.h stats.h trace.h tracefmt.h yalloc.h
 
-#cc os.o os.c os.h
-#cc stdio.o stdio.c stdio.h printf.h
+cc ytrace.o ytrace.c base.h printf.h tracefmt.h
+ld ytrace "ytrace.o printf.o"
+
+cc os.o os.c os.h
+
+# shared library to preload. initial-exec TLS keeps thread_heap in the static TLS block, usable before any allocation
+verbose "$cc -shared -o libyalloc.so" "$cc -shared -fPIC $cflags -ftls-model=initial-exec -o libyalloc.so yalloc.c os.c printf.c -lpthread"
+$cc -shared -fPIC $cflags -ftls-model=initial-exec -o libyalloc.so yalloc.c os.c printf.c -lpthread
+
+# benchmarks against a symbol-prefixed build, next to libc malloc
+verbose "$cc -c -DYal_prefix yalloc.c" "$cc -c $cflags -DYal_prefix -o yalloc_p.o yalloc.c"
+$cc -c $cflags -DYal_prefix -o yalloc_p.o yalloc.c
+
+cc bench.o bench.c base.h bench.h yalloc.h
+ld bench "bench.o yalloc_p.o os.o printf.o -lpthread"
 
-#cc test.o test.c stdlib.h
+cc mtbench.o mtbench.c base.h bench.h yalloc.h
+ld mtbench "mtbench.o yalloc_p.o os.o printf.o -lpthread"
+
+# C++ operator new and delete, and container workloads with and without
+cxxflags="$copt -std=c++17 -Wall -g1"
+verbose "$cxx -c new.cpp" "$cxx -c $cxxflags new.cpp"
+$cxx -c $cxxflags new.cpp
+verbose "$cxx -o newbench" "$cxx -o newbench $cxxflags newbench.cpp new.o yalloc.o os.o printf.o -lpthread"
+$cxx -o newbench $cxxflags newbench.cpp new.o yalloc.o os.o printf.o -lpthread
+$cxx -o newbench_sys $cxxflags newbench.cpp
+verbose "$cxx -o allocbench" "$cxx -o allocbench $cxxflags allocbench.cpp yalloc_p.o os.o printf.o -lpthread"
+$cxx -o allocbench $cxxflags allocbench.cpp yalloc_p.o os.o printf.o -lpthread
+
+cc yreplay.o yreplay.c base.h bench.h tracefmt.h yalloc.h
+ld yreplay "yreplay.o yalloc_p.o os.o printf.o -lpthread"
+
+#cc stdio.o stdio.c stdio.h printf.h
 
-#ld test "test.o yalloc.o os.o printf.o"
+# cross-thread checks, linked with yalloc.o itself
+cc test.o test.c yalloc.h
+ld test "test.o yalloc.o os.o printf.o -lpthread"
 
 # ~/bin/valgrind -s --redzone-size=4096 --exit-on-first-error=yes --error-exitcode=1 --track-fds=yes --leak-check=no --partial-loads-ok=no --track-origins=yes --malloc-fill=55 $*
@@ -0,0 +1,170 @@
+/* conf.h - runtime configuration
+
+   This file is part of yalloc, yet another memory allocator with emphasis on efficiency and compactness.
+
+   SPDX-FileCopyrightText: © 2024 Joris van der Geer
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+  The dynamic config vars in config.h can be set at startup from environment variable YALLOC_CONF, and later by mallopt()
+  Format is a comma-separated list of name=value, with an optional k,m,g suffix for values. e.g.
+
+    YALLOC_CONF=mmap_threshold=32m,mmap_cache=64m,trim_threshold=1m,numa=1,prof=512k
+
+  Parsing is done before the first heap is set up and does not allocate.
+
+  Log categories are given by YALLOC_LOG as a comma-separated list of source names, e.g. YALLOC_LOG=region,heap or 'all'. See enum File
+  They can be changed at runtime with yal_log()
+
+  YALLOC_TRACE=<file> writes a binary trace from the start, see trace.h
+*/
+
+enum Conf { Cinireg,Cinidir,Cmmap_threshold,Cmmap_cache,Ctrim_threshold,Csafe_mode,Cguardbit,Cnuma,Cprof,Ccount };
+
+static cchar *confnames[Ccount] = { "inireg","inidir","mmap_threshold","mmap_cache","trim_threshold","safe_mode","guardbit","numa","prof" };
+
+enum Confstate { Conf_none,Conf_busy,Conf_done };
+
+static _Atomic ub4 conf_done; // enum Confstate, Conf_done published with release after all settings
+static _Thread_local bool conf_self; // this thread runs yal_conf()
+
+static pthread_key_t heap_key; // destructor releases the heap at thread exit
+static bool heap_keyok;
+
+// set a knob, bounded. returns 0 if out of range
+static bool setconf(enum Conf c,size_t val)
+{
+  switch (c) {
+  case Cinireg: if (val == 0 || val >= Regmem_inc) return 0; inireg = (ub4)val; break;
+  case Cinidir: if (val == 0 || val > 64) return 0; inidir = (ub4)val; break;
+  case Cmmap_threshold: if (val < Page || val > (1ul << Maxorder)) return 0; mmap_threshold = val; mmap_dynamic = 0; break;
+  case Cmmap_cache: mmap_cache_max = val; break;
+  case Ctrim_threshold: regfree_trim = (ub4)min(val >> Minregion,Region_cnt); break; // in regions
+  case Csafe_mode: safe_mode = (val != 0); break;
+  case Cguardbit: if (val > 1) return 0; guardbit = (ub4)val; break;
+  case Cnuma: numa_mode = (val != 0); break;
+  case Cprof: prof_rate = val; break;
+  case Ccount: return 0;
+  }
+  return 1;
+}
+
+static bool confnam(cchar *s,ub4 n,cchar *name)
+{
+  ub4 i;
+
+  for (i = 0; i < n; i++) if (name[i] != s[i]) return 0;
+  return name[n] == 0;
+}
+
+static void parseconf(cchar *s)
+{
+  cchar *nam;
+  ub4 n;
+  size_t val;
+  enum Conf c;
+  char x;
+
+  while (*s) {
+    nam = s;
+    while (*s && *s != '=' && *s != ',') s++;
+    n = (ub4)(s - nam);
+    for (c = 0; c < Ccount; c++) if (confnam(nam,n,confnames[c])) break;
+
+    val = 0;
+    if (*s == '=') {
+      s++;
+      while (*s >= '0' && *s <= '9') val = val * 10 + (size_t)(*s++ - '0');
+      x = *s | 0x20;
+      if (x == 'k') { val <<= 10; s++; }
+      else if (x == 'm') { val <<= 20; s++; }
+      else if (x == 'g') { val <<= 30; s++; }
+    } else val = 1;
+
+    if (c == Ccount || (*s && *s != ',')) error(__LINE__,Fconf,"YALLOC_CONF: unknown or invalid item at '%.*s'",(int)n,nam);
+    else if (setconf(c,val) == 0) error(__LINE__,Fconf,"YALLOC_CONF: %s value %zu out of range",confnames[c],val);
+    else ylog(Fconf,"conf %s = %zu",confnames[c],val);
+
+    while (*s && *s != ',') s++;
+    if (*s) s++;
+  }
+}
+
+// log category names are source names without extension
+static ub4 logmask(cchar *s)
+{
+  cchar *nam,*fnam;
+  ub4 n,i;
+  ub4 mask = 0;
+  enum File f;
+
+  while (*s) {
+    nam = s;
+    while (*s && *s != ',') s++;
+    n = (ub4)(s - nam);
+    if (n == 3 && nam[0] == 'a' && nam[1] == 'l' && nam[2] == 'l') mask = hi32;
+    else {
+      for (f = 0; f < Fcount; f++) {
+        fnam = fnames[f];
+        for (i = 0; i < n && fnam[i] == nam[i]; i++) ;
+        if (i == n && (fnam[i] == 0 || fnam[i] == '.')) break;
+      }
+      if (f < Fcount) mask |= (1u << f);
+      else error(__LINE__,Fconf,"YALLOC_LOG: unknown category '%.*s'",(int)n,nam);
+    }
+    if (*s) s++;
+  }
+  return mask;
+}
+
+unsigned int yal_log(const char *cats)
+{
+#if Yal_enable_log
+  ub4 old = ylog_mask;
+
+  if (cats) ylog_mask = logmask(cats);
+  return old;
+#else
+  return 0;
+#endif
+}
+
+// once, at first heap. Other threads wait until done, recursion from within returns
+static void yal_conf(void)
+{
+  cchar *s,*kern;
+  ub4 state = Conf_none;
+
+  if (atomic_compare_exchange_strong_explicit(&conf_done,&state,Conf_busy,memory_order_acquire,memory_order_acquire) == 0) {
+    if (conf_self) return;
+    while (atomic_load_explicit(&conf_done,memory_order_acquire) != Conf_done) osyield();
+    return;
+  }
+  conf_self = 1;
+
+  heap_keyok = (pthread_key_create(&heap_key,heap_exit) == 0);
+
+  kern = ntinit();
+
+  s = getenv("YALLOC_CONF");
+  if (s) parseconf(s);
+
+#if Yal_enable_log
+  s = getenv("YALLOC_LOG");
+  if (s) ylog_mask = logmask(s);
+#endif
+  ylog(Fconf,"copy and fill: %s from %zu`b",kern,nt_threshold);
+
+#if Yal_enable_trace
+  int fd;
+
+  s = getenv("YALLOC_TRACE");
+  if (s && *s) {
+    fd = oscreate(s);
+    if (fd == -1) error(__LINE__,Fconf,"YALLOC_TRACE: cannot create '%s'",s);
+    else yal_trace(fd);
+  }
+#endif
+
+  conf_self = 0;
+  atomic_store_explicit(&conf_done,Conf_done,memory_order_release);
+}
@@ -23,6 +23,7 @@
 // slab
 //#define Maxsizclas 16
 #define Maxclasslen 4096u
+#define Calencnt ((Maxclasslen >> 4) + 17) // class indices 2 .. 272 from len, see yalloc_heap()
 #define Clas_threshold 0u
 // #define Maxclas_len (1U << Maxsizclas)
 // #define Maxclas_cnt (1U << (Maxsizclas + Sizestep))
@@ -66,7 +67,7 @@
 #define  Iniheap 0x20000u
 #define Inimem 0x400u
 // #define Initdir 8
-// #define Bootmem 0x1000
+#define Bootmem 0x4000u // static, for allocations while a heap is being set up
 #define Heap_del_threshhold 16
 
 // buddy
@@ -85,22 +86,65 @@
 #define Basealign 8u
 
 #define Page 4096u
+#define Pagebits 12
 
 // diag
-#define Yal_enable_log 1
+#define Yal_enable_log 1 // text, one write per line. categories selected at runtime
 #define Yal_enable_stats 1
+#define Yal_enable_trace 1 // binary event rings
+#define Trace_ring 14 // log2 records per heap
+#define Yal_enable_latency 0 // per-path tsc histograms, costs two tsc reads per call
 
 #define Mmap_threshold (1ul << 24)
 
+#define Zero_purge_len 0x40000u // calloc of a previously used block from this size on zeroes by discarding its pages
+
+// non-temporal copy and fill for realloc and calloc from the last-level cache size on
+#define Yal_enable_ntcopy 1
+#define Nt_threshold (1ul << 23) // if the cache size is unknown
+#define Nt_min (1ul << 20)
+#define Mmap_dyn_max (1ul << (Maxorder - 1)) // adaptive threshold limit
+
+#define Mmap_cache 8 // #released mmap blocks kept
+#define Mmap_cache_max (1ul << 28) // bytes
+
+#define Yal_enable_numa 1
+
+// heap profiler
+#define Yal_enable_prof 1
+#define Prof_depth 16 // backtrace frames
+#define Prof_tab 12 // log2 side table entries per heap
+
+#define Fragbuf 4096 // fragmentation report line buffer
+
+// latency-critical mode
+#define Crit_defer 16 // #unmaps deferred while critical
+
+#ifndef Yal_prefix // prefixed build leaves the glibc extensions to libc
 #define Yal_glibc_mtrace 1
 
+#define Y_enable_mallopt 1
+#if Yal_enable_stats
+ #define Y_enable_mallinfo 1
+ #define Y_enable_glibc_malloc_stats 1
+#endif
+#endif
+
 // Dynamic config vars with initial value
 
 static unsigned int inireg = 16; // Initial region size
 static unsigned int inidir = 8; // preallocated directory entries
 
 // static unsigned int mmap_threshold_bit = 24;
-static size_t mmap_threshold = Mmap_threshold;
+static size_t mmap_threshold = Mmap_threshold; // initial, per heap adaptive
+static unsigned int mmap_dynamic = 1; // unless set explicitly
+static size_t mmap_cache_max = Mmap_cache_max;
+
+static unsigned int numa_mode = 0; // bind region memory to the heap's node
+
+static size_t prof_rate = 0; // mean bytes between samples, 0 is off
+
+static unsigned int regfree_trim = Regfree_trim; // #deleted regions to keep memory for
 
 static unsigned int safe_mode = 1;
 static unsigned int guardbit = 0;
@@ -0,0 +1,154 @@
+/* copy.h - block copy and zero fill
+
+   This file is part of yalloc, yet another memory allocator with emphasis on efficiency and compactness.
+
+   SPDX-FileCopyrightText: © 2024 Joris van der Geer
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+  Used for realloc() copies and calloc() fills. Blocks of at least the last-level cache size are written with
+  non-temporal stores, so a large realloc or calloc does not evict the calling thread's working set.
+  Kernels for AVX-512, AVX2 and SSE2 are selected once at first heap creation. Below the threshold, or on other
+  platforms, libc memcpy and memset are used.
+*/
+
+#if Yal_enable_ntcopy && defined __x86_64__ && (Isgcc || Isclang)
+ #include <immintrin.h>
+ #define Ntkernels 1
+#else
+ #define Ntkernels 0
+#endif
+
+#if Ntkernels
+
+// kernels: d is 64-byte aligned and n a multiple of 64
+
+static __attribute__((target("avx512f"))) void ntcopy_avx512(char *d,const char *s,size_t n)
+{
+  for (; n; n -= 64, d += 64, s += 64) _mm512_stream_si512((__m512i *)d,_mm512_loadu_si512(s));
+  _mm_sfence();
+}
+
+static __attribute__((target("avx2"))) void ntcopy_avx2(char *d,const char *s,size_t n)
+{
+  __m256i a,b;
+
+  for (; n; n -= 64, d += 64, s += 64) {
+    a = _mm256_loadu_si256((const __m256i *)s);
+    b = _mm256_loadu_si256((const __m256i *)(s + 32));
+    _mm256_stream_si256((__m256i *)d,a);
+    _mm256_stream_si256((__m256i *)(d + 32),b);
+  }
+  _mm_sfence();
+}
+
+static void ntcopy_sse2(char *d,const char *s,size_t n)
+{
+  __m128i a,b,c,e;
+
+  for (; n; n -= 64, d += 64, s += 64) {
+    a = _mm_loadu_si128((const __m128i *)s);
+    b = _mm_loadu_si128((const __m128i *)(s + 16));
+    c = _mm_loadu_si128((const __m128i *)(s + 32));
+    e = _mm_loadu_si128((const __m128i *)(s + 48));
+    _mm_stream_si128((__m128i *)d,a);
+    _mm_stream_si128((__m128i *)(d + 16),b);
+    _mm_stream_si128((__m128i *)(d + 32),c);
+    _mm_stream_si128((__m128i *)(d + 48),e);
+  }
+  _mm_sfence();
+}
+
+static __attribute__((target("avx512f"))) void ntzero_avx512(char *d,size_t n)
+{
+  __m512i z = _mm512_setzero_si512();
+
+  for (; n; n -= 64, d += 64) _mm512_stream_si512((__m512i *)d,z);
+  _mm_sfence();
+}
+
+static __attribute__((target("avx2"))) void ntzero_avx2(char *d,size_t n)
+{
+  __m256i z = _mm256_setzero_si256();
+
+  for (; n; n -= 64, d += 64) {
+    _mm256_stream_si256((__m256i *)d,z);
+    _mm256_stream_si256((__m256i *)(d + 32),z);
+  }
+  _mm_sfence();
+}
+
+static void ntzero_sse2(char *d,size_t n)
+{
+  __m128i z = _mm_setzero_si128();
+
+  for (; n; n -= 64, d += 64) {
+    _mm_stream_si128((__m128i *)d,z);
+    _mm_stream_si128((__m128i *)(d + 16),z);
+    _mm_stream_si128((__m128i *)(d + 32),z);
+    _mm_stream_si128((__m128i *)(d + 48),z);
+  }
+  _mm_sfence();
+}
+
+static void (*ntcopy)(char *d,const char *s,size_t n);
+static void (*ntzero)(char *d,size_t n);
+
+#endif // Ntkernels
+
+static size_t nt_threshold = Nt_threshold;
+
+static cchar *ntinit(void)
+{
+  size_t llc = oscachelen();
+
+  if (llc) nt_threshold = max(llc,Nt_min);
+
+#if Ntkernels
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) { ntcopy = ntcopy_avx512; ntzero = ntzero_avx512; return "avx512"; }
+  if (__builtin_cpu_supports("avx2")) { ntcopy = ntcopy_avx2; ntzero = ntzero_avx2; return "avx2"; }
+  ntcopy = ntcopy_sse2; ntzero = ntzero_sse2;
+  return "sse2";
+#else
+  return "libc";
+#endif
+}
+
+static void ycopy(void *dst,const void *src,size_t len)
+{
+#if Ntkernels
+  char *d = dst;
+  const char *s = src;
+  size_t head,bulk;
+
+  if (len >= nt_threshold && ntcopy) {
+    head = (64 - ((size_t)d & 63)) & 63;
+    memcpy(d,s,head);
+    bulk = (len - head) & ~(size_t)63;
+    ntcopy(d + head,s + head,bulk);
+    head += bulk;
+    memcpy(d + head,s + head,len - head);
+    return;
+  }
+#endif
+  memcpy(dst,src,len);
+}
+
+static void yzero(void *p,size_t len)
+{
+#if Ntkernels
+  char *d = p;
+  size_t head,bulk;
+
+  if (len >= nt_threshold && ntzero) {
+    head = (64 - ((size_t)d & 63)) & 63;
+    memset(d,0,head);
+    bulk = (len - head) & ~(size_t)63;
+    ntzero(d + head,bulk);
+    head += bulk;
+    memset(d + head,0,len - head);
+    return;
+  }
+#endif
+  memset(p,0,len);
+}
@@ -6,9 +6,11 @@
    SPDX-License-Identifier: GPL-3.0-or-later
 */
 
-enum File { Falloc,Fbuddy,Ffree,Fheap,Fos,Frealloc,Fregion,Fslab,Fstd,Fyalloc,Ftest,Fcount };
+enum File { Falloc,Fbuddy,Fconf,Ffree,Fheap,Fmmap,Fnuma,Fos,Fprof,Frealloc,Fregion,Freserve,Fslab,Fstats,Fstd,Fyalloc,Ftest,Fcount };
 
-static cchar *fnames[Fcount] = { "alloc.h","buddy.h","free","heap.h","os.h","realloc","region.h","slab.h","std.h","yalloc.c","test.c" };
+sassert(Fcount <= 32,"log categories fit a 32-bit mask");
+
+static cchar *fnames[Fcount] = { "alloc.h","buddy.h","conf.h","free","heap.h","mmap.h","numa.h","os.h","prof.h","realloc","region.h","reserve.h","slab.h","stats.h","std.h","yalloc.c","test.c" };
 
 static void _Printf(3,4) error(ub4 line,enum File file,cchar *fmt,...)
 {
@@ -31,7 +33,10 @@ static void _Printf(3,4) error(ub4 line,enum File file,cchar *fmt,...)
 }
 
 #if Yal_enable_log
-  #define ylog(f,fmt,...) do_ylog(__LINE__,f,fmt,__VA_ARGS__);
+static ub4 ylog_mask; // bit set per enabled enum File category
+
+  #define ylog(f,fmt,...) do { if (unlikely(ylog_mask & (1u << (f)))) do_ylog(__LINE__,f,fmt,__VA_ARGS__); } while (0);
+  #define ylogl(line,f,fmt,...) do { if (unlikely(ylog_mask & (1u << (f)))) do_ylog(line,f,fmt,__VA_ARGS__); } while (0);
 static void _Printf(3,4) do_ylog(ub4 line,enum File file,cchar *fmt,...)
 {
   va_list ap;
@@ -52,8 +57,51 @@ static void _Printf(3,4) do_ylog(ub4 line,enum File file,cchar *fmt,...)
   oswrite(diag_fd,buf,n+1);
 }
 #else
-  #define ylog(f,fmt,...)
-  #define do_ylog(fl,,fmt,...)
+  #define ylog(f,fmt,...) do {} while (0); // a statement as above, e.g. for 'if (x) ylog(..);'
+  #define ylogl(line,f,fmt,...) do {} while (0);
+#endif
+
+#if defined __x86_64__ || defined __i386__
+  #define ytsc() __builtin_ia32_rdtsc()
+#elif defined __aarch64__
+static inline ub8 ytsc(void)
+{
+  ub8 v;
+
+  __asm__ volatile("mrs %0, cntvct_el0" : "=r" (v));
+  return v;
+}
+#else
+  #define ytsc() 0
+#endif
+
+#if Yal_enable_trace
+  #define ytracel(line,f,hb,op,len,p,regid) do { if (unlikely(atomic_load_explicit(&trace_fd,memory_order_relaxed) >= 0)) trace_rec(line,f,hb,op,len,p,regid); } while (0);
+#else
+  #define ytracel(line,f,hb,op,len,p,regid) do {} while (0); // a statement as ylog()
+#endif
+#define ytrace(f,hb,op,len,p,regid) ytracel(__LINE__,f,hb,op,len,p,regid)
+
+#if Yal_enable_trace
+  #define ytraceapi(op,len,p,arg) do { if (unlikely(atomic_load_explicit(&trace_fd,memory_order_relaxed) >= 0)) trace_api(__LINE__,op,len,p,arg); } while (0);
+#else
+  #define ytraceapi(op,len,p,arg) do {} while (0);
+#endif
+
+#if Yal_enable_latency
+  #define ylat(hb,path) (hb)->latpath = max((hb)->latpath,(ub4)(path)); // slowest path taken in this call
+#else
+  #define ylat(hb,path)
+#endif
+
+#if Yal_enable_stats
+  #define ystat(hb,fld) (hb)->stat.fld++;
+  #define ystatn(hb,fld,n) (hb)->stat.fld += (n);
+  #define ystatdec(hb,fld,n) (hb)->stat.fld -= (n);
+#else
+  #define ystat(hb,fld)
+  #define ystatn(hb,fld,n)
+  #define ystatdec(hb,fld,n)
 #endif
 
 static void *oom(ub4 line,ub4 file,size_t n1,size_t n2)
@@ -0,0 +1,183 @@
+/* frag.h - fragmentation and occupancy report
+
+   This file is part of yalloc, yet another memory allocator with emphasis on efficiency and compactness.
+
+   SPDX-FileCopyrightText: © 2024 Joris van der Geer
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+  Walks the region pools of the calling thread's heap: the initial pool in the heap base, then the chain from nxtregs.
+  Slab regions are assessed from their allocated bitmap 'line', buddy regions from their order map.
+  Per region: occupancy, free cel runs, fully free pages, metadata and cels held in the recycling bin.
+  Regions deleted yet with retained memory are reported as such.
+  Output is an array of struct yal_regreport records and/or a summary table.
+*/
+
+#define Fragruns 8 // log2 buckets of free run lengths
+
+static ub4 runbucket(ub4 run)
+{
+  ub4 b = 31 - clz(run);
+
+  return min(b,Fragruns - 1);
+}
+
+static bool celbit(const ub8 *line,ub4 cel)
+{
+  return (line[cel >> 6] >> (cel & 63)) & 1;
+}
+
+static void frag_slab(heap *hb,region *reg,struct yal_regreport *rp)
+{
+  const ub8 *line = reg->meta;
+  struct binentry *binp;
+  ub4 cel,cnt = reg->celcnt;
+  ub4 cellen = reg->cellen;
+  ub4 run = 0;
+  ub4 pg,pgcnt,c0,c1;
+  ub4 e,binmask;
+
+  rp->cellen = cellen;
+  rp->cels = cnt;
+  for (cel = 0; cel < cnt; cel++) {
+    if (celbit(line,cel)) {
+      rp->used++;
+      if (run) rp->runs[runbucket(run)]++;
+      run = 0;
+    } else run++;
+  }
+  if (run) rp->runs[runbucket(run)]++;
+
+  // pages without any allocated cel
+  pgcnt = (ub4)(((size_t)cnt * cellen) / Page);
+  for (pg = 0; pg < pgcnt; pg++) {
+    c0 = (ub4)(((size_t)pg * Page) / cellen);
+    c1 = (ub4)(((size_t)(pg + 1) * Page - 1) / cellen);
+    for (cel = c0; cel <= c1 && cel < cnt; cel++) if (celbit(line,cel)) break;
+    if (cel > c1 || cel == cnt) rp->freepages++;
+  }
+
+  if (reg->clas >= Maxclass) return;
+  binmask = hb->binmasks[reg->clas];
+  binp = hb->bins + reg->clas * Bin;
+  for (e = 0; e < Bin; e++) {
+    if ( (binmask & (1u << e)) && binp[e].reg == reg) rp->binheld++;
+  }
+}
+
+// granules covered by a block start per the order map
+static void frag_buddy(region *reg,struct yal_regreport *rp)
+{
+  ub4 minord = reg->minorder;
+  ub4 ordrng = reg->order - minord;
+  const ub1 *ordline = buddy_ordline(reg);
+  ub4 g,gcnt = 1u << ordrng;
+  ub4 run = 0;
+  ub4 ord,n;
+  size_t pg0,pg1,nxtpg = 0,usedpages = 0; // pages with any part of a block
+  size_t pgcnt = ((size_t)gcnt << minord) / Page;
+
+  rp->cellen = 1u << minord;
+  rp->cels = gcnt;
+  for (g = 0; g < gcnt; ) {
+    ord = ordline[g];
+    if (ord >= minord) {
+      if (run) rp->runs[runbucket(run)]++;
+      run = 0;
+      n = 1u << (ord - minord);
+      pg0 = max(((size_t)g << minord) / Page,nxtpg);
+      pg1 = min((((size_t)(g + n) << minord) - 1) / Page,pgcnt - 1);
+      if (pg1 >= pg0) {
+        usedpages += pg1 - pg0 + 1;
+        nxtpg = pg1 + 1;
+      }
+      rp->used += n;
+      g += n;
+    } else {
+      run++;
+      g++;
+    }
+  }
+  if (run) rp->runs[runbucket(run)]++;
+  rp->freepages = (ub4)(pgcnt - usedpages); // as frag_slab(), pages without any allocated byte
+}
+
+static void frag_region(heap *hb,region *reg,struct yal_regreport *rp)
+{
+  memset(rp,0,sizeof(*rp));
+  rp->heap = hb->id;
+  rp->reg = reg->id;
+  rp->typ = reg->typ;
+  rp->order = reg->order;
+  rp->clas = reg->clas;
+  rp->metalen = reg->metalen;
+
+  switch (reg->typ) {
+  case Rnil: rp->len = 1ul << reg->order; rp->freepages = (ub4)(rp->len / Page); break; // retained
+  case Rslab: rp->len = 1ul << reg->order; if (reg->meta) frag_slab(hb,reg,rp); break;
+  case Rbuddy: rp->len = 1ul << reg->order; if (reg->meta) frag_buddy(reg,rp); break;
+  case Rxbuddy: break;
+  case Rmmap: rp->len = reg->len; rp->cellen = 0; rp->cels = rp->used = 1; rp->metalen = 0; break;
+  }
+}
+
+static void frag_line(char *buf,ub4 *ppos,const struct yal_regreport *rp)
+{
+  static cchar *typnames[] = { "free","buddy","xbuddy","slab","mmap" };
+  ub4 pos = *ppos;
+  ub4 pct = rp->cels ? (ub4)(((size_t)rp->used * 100) / rp->cels) : 0;
+  ub4 b;
+
+  pos += mini_snprintf(buf,pos,Fragbuf,"%5u %-6s %9lu`b %4u %6u %8u %3u%% %6u %5u %8lu`b ",
+    rp->reg,typnames[rp->typ < 5 ? rp->typ : 0],rp->len,rp->cellen,rp->cels,rp->used,pct,rp->binheld,rp->freepages,rp->metalen);
+  for (b = 0; b < Fragruns; b++) pos += mini_snprintf(buf,pos,Fragbuf," %u",rp->runs[b]);
+  buf[pos++] = '\n';
+  *ppos = pos;
+}
+
+// report to binfd as records and/or txtfd as table. returns #regions
+int yal_frag_report(int binfd,int txtfd)
+{
+  heap *hb = thread_heap;
+  region *pool,*reg;
+  struct yal_regreport rep;
+  char buf[Fragbuf];
+  ub4 i,cnt,first;
+  ub4 pos = 0;
+  ub4 regcnt = 0;
+  size_t used = 0,tot = 0,meta = 0,freepg = 0;
+
+  if (hb == nil || ((size_t)hb & 1)) return 0;
+
+  if (txtfd >= 0) pos = mini_snprintf(buf,0,Fragbuf,"heap %u\n  reg type        len  cel   cels     used  occ    bin fpage     meta  free runs 1 2 4 8 16 32 64 128+\n",hb->id);
+
+  pool = hb->regini;
+  cnt = hb->nxtregs ? hb->reginitop : hb->regmem_pos;
+  first = 0;
+  do {
+    for (i = first; i < cnt; i++) {
+      reg = pool + i;
+      if (reg->user == nil) continue;
+      frag_region(hb,reg,&rep);
+      regcnt++;
+      tot += rep.len;
+      meta += rep.metalen;
+      freepg += rep.freepages;
+      used += rep.cellen ? (size_t)rep.used * rep.cellen : (rep.typ == Rmmap ? rep.len : 0);
+      if (binfd >= 0) oswrite(binfd,(cchar *)&rep,sizeof(rep));
+      if (txtfd >= 0) {
+        if (pos + 256 > Fragbuf) { oswrite(txtfd,buf,pos); pos = 0; }
+        frag_line(buf,&pos,&rep);
+      }
+    }
+    pool = (pool == hb->regini) ? hb->nxtregs : pool->nxt; // first entry of os pools links to next
+    cnt = (pool == hb->regmem) ? hb->regmem_pos : Regmem_inc;
+    first = 1;
+  } while (pool);
+
+  if (txtfd >= 0) {
+    pos += mini_snprintf(buf,pos,Fragbuf,"  %u regions %lu`b used %lu`b = %lu%% free pages %lu`b meta %lu`b\n",
+      regcnt,tot,used,tot ? (used * 100) / tot : 0,freepg * Page,meta);
+    oswrite(txtfd,buf,pos);
+  }
+  return (int)regcnt;
+}
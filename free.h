@@ -6,8 +6,60 @@
    SPDX-License-Identifier: GPL-3.0-or-later
 
   Handle recycling bin and eventually pass on to slab, buddy or mmap region.free()
+
+  A block from another thread's heap is pushed onto that heap's remote list, drained by its owner on the next malloc().
+  The owner is found from the global directory in region.h. If its thread has exited, the freeing thread drains the list itself.
+  The list is linked through the block itself. 2- and 4-byte cels are too small for a link and go via a node.
+  The owner thus frees the block itself, including its bump header and heap profile sample.
 */
 
+static void yfree_heap(heap *hb,void *p,size_t len);
+
+static void remote_push(_Atomic(void *) *list,void *p)
+{
+  void *head = atomic_load_explicit(list,memory_order_relaxed);
+
+  do *(void **)p = head;
+  while (atomic_compare_exchange_weak_explicit(list,&head,p,memory_order_release,memory_order_relaxed) == 0);
+}
+
+// p is not in hb. Find its owner in constant time via the global directory, and pass it on
+static bool remote_free(heap *hb,void *p)
+{
+  size_t ip = (size_t)p;
+  char *cp = p;
+  size_t ent = gdir_find(ip);
+  heap *xb;
+  region *reg = nil;
+  void **node;
+
+  if (ent & Gtag_heap) { // bump blocks have room for a link
+    xb = (heap *)(ent & ~(size_t)Gtag_msk);
+    if (cp < xb->inimem + 4 || cp >= xb->inimem + Inimem) return 0;
+  } else if (ent & Gtag_reg) {
+    reg = (region *)(ent & ~(size_t)Gtag_msk);
+    xb = atomic_load_explicit(&reg->owner,memory_order_relaxed);
+  } else return 0;
+  if (xb == hb) return 0;
+
+  ylog(Ffree,"heap %u free %p of heap %u reg %u",hb->id,p,xb->id,reg ? reg->id : 0);
+  if (reg && reg->typ == Rslab && reg->cellen < sizeof(void *)) {
+    node = yalloc_heap(hb,2 * sizeof(void *),0);
+    if (node == nil) return 1; // leak
+    node[1] = p;
+    remote_push(&xb->remotetiny,node);
+  } else remote_push(&xb->remote,p);
+
+  // the owner may have exited before our push. See heap_exit()
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(&xb->inuse,memory_order_relaxed) == Heap_orphan) orphan_drain(xb);
+
+  ystat(hb,freeremote)
+  ylat(hb,Yal_lat_remote)
+  ytrace(Ffree,hb,Tfree,0,p,0)
+  return 1;
+}
+
 static bool free_mmap(heap *hb,region *rp,size_t ip)
 {
   size_t len = rp->len;
@@ -15,7 +67,8 @@ static bool free_mmap(heap *hb,region *rp,size_t ip)
   // if (unlikely(mp == 0)) { error(__LINE__,Falloc,"free-mmap(): double free of ptr %z of len %z",ip,len); return; }
   // if (unlikely(ip != mp)) { error(__LINE__,Falloc,"free-mmap(): invalid ptr %z",ip); return; }
   if (unlikely(ip & (Page - 1))) { error(__LINE__,Falloc,"free-mmap(): invalid ptr %zx",ip); return 0; }
-  if (unlikely(len < Mmap_threshold)) { error(__LINE__,Falloc,"free: ptr %zx len %zu` was not mmap()ed",ip,len); return 0; }
+  if (unlikely(len == 0 || (len & (Page - 1)))) { error(__LINE__,Falloc,"free: ptr %zx len %zu` was not mmap()ed",ip,len); return 0; } // may have shrunk below threshold
+  ystatdec(hb,mmaplen,len)
   // if (unlikely(len > (1UL << Vmsize)) { error(__LINE__,Falloc,"free: ptr %z len `%Ilu was not mmap()ed",ip,len); return; }
   return delregion(hb,rp);
 }
@@ -69,7 +122,6 @@ static void yfree_heap(heap *hb,void *p,size_t len)
 {
   size_t xp,ip = (size_t)p;
   char *cp = p;
-  void *ap;
   ub4 *up;
   region *reg,*nxreg,*pxreg,*clreg,*oldreg;
   struct binentry *binp;
@@ -77,9 +129,15 @@ static void yfree_heap(heap *hb,void *p,size_t len)
   ub4 binmask,old,new;
 
   if (cp >= hb->inimem + 4 && cp < hb->inimem + Inimem) {
+#if Yal_enable_prof
+    if (unlikely(hb->profcnt != 0)) prof_free(hb,p);
+#endif
     up = ((ub4 *)cp) - 1;
     if (*up == 0) free2(__LINE__,Ffree,p,0,"in bootmem");
+    else hb->bumpcnt--;
     *up = 0;
+    ystat(hb,freebump)
+    ytrace(Ffree,hb,Tfree,len,p,0)
     return; // initial bump alloc
   }
 
@@ -91,15 +149,23 @@ static void yfree_heap(heap *hb,void *p,size_t len)
   reg = findregion(hb,ip);
 
   if (reg == nil) {
+    if (remote_free(hb,p)) return;
     error(__LINE__,Ffree,"free(%p) of unallocated pointer",p);
     return;
   }
+  ytrace(Ffree,hb,Tfree,len,p,reg->id)
+
+  // samples are dropped by the owner only, remote frees via remote_drain()
+#if Yal_enable_prof
+  if (unlikely(hb->profcnt != 0)) prof_free(hb,p);
+#endif
 
   // slab
   clas = reg->clas;
   if (clas != Noclass) {
     len = reg->len;
     if (slab_chk4free(hb,reg,ip)) return;
+    ystat(hb,freeslab)
 
     // put in recycling bin
     binmask = hb->binmasks[clas];
@@ -110,6 +176,7 @@ static void yfree_heap(heap *hb,void *p,size_t len)
       new = 0;
       oldreg = binp[old].reg;
       xp =(size_t) binp[old].p;
+      ystat(hb,binevict)
       if (slab_free(hb,oldreg,xp)) { // free oldest item
         nxreg = oldreg->nxt;
         pxreg = oldreg->prv;
@@ -141,35 +208,75 @@ static void yfree_heap(heap *hb,void *p,size_t len)
   }
 
   if (reg->typ == Rbuddy) {
+    ystat(hb,freebuddy)
     if (buddy_free(hb,reg,ip)) {
       delregion(hb,reg);
     }
   } else if (reg->typ == Rmmap) {
-    if (len && len != reg->len) error(__LINE__,Ffree,"free_sized(%p,%zu) mmap block had size %zu",p,len,reg->len);
+    if (len > reg->len) error(__LINE__,Ffree,"free_sized(%p,%zu) mmap block had size %zu",p,len,reg->len);
     cp = reg->user;
-    ap = reg->meta;
-    if (ap) {
-      if (p != ap) { error(__LINE__,Ffree,"free(%p) is %zu`b in aligned mmap block allocated at %p from %p",p,(size_t)p - (size_t)ap,ap,cp); return; }
-    } else {
-      if (p != cp) { error(__LINE__,Ffree,"free(%p) is %zu`b in mmap block allocated at %p",p,(size_t)p - (size_t)cp,cp); return; }
-    }
+    if (p != cp) { error(__LINE__,Ffree,"free(%p) is %zu`b in mmap block allocated at %p",p,(size_t)p - (size_t)cp,cp); return; }
+    ystat(hb,freemmap)
     if (free_mmap(hb,reg,ip)) delheap(hb,0); // todo
     return;
   }
 }
 
+// free blocks other threads returned to us
+static void remote_drain(heap *hb)
+{
+  void **p,**nxt,**node;
+
+  p = atomic_exchange_explicit(&hb->remote,nil,memory_order_acquire);
+  while (p) {
+    nxt = *p;
+    yfree_heap(hb,p,0);
+    p = nxt;
+  }
+
+  node = atomic_exchange_explicit(&hb->remotetiny,nil,memory_order_acquire);
+  while (node) {
+    nxt = node[0];
+    yfree_heap(hb,node[1],0);
+    yfree_heap(hb,node,0); // back to the freeing heap
+    node = nxt;
+  }
+}
+
+// free blocks returned to a heap whose thread exited, under a short lock. Frees pushed meanwhile are picked up by the next round
+static void orphan_drain(heap *xb)
+{
+  ub4 use;
+
+  do {
+    use = Heap_orphan;
+    if (atomic_compare_exchange_strong(&xb->inuse,&use,Heap_drain) == 0) return; // adopted, deleted or being drained
+    ylog(Ffree,"drain exited heap %u",xb->id);
+    remote_drain(xb);
+    use = Heap_drain;
+    if (atomic_compare_exchange_strong(&xb->inuse,&use,Heap_orphan) == 0) return; // deleted when it became empty
+  } while (atomic_load(&xb->remote) || atomic_load(&xb->remotetiny));
+}
+
 static void yfree(void *p,size_t len)
 {
   heap *hb;
 
-  // oswrite(2,"yfree 1\n",8);
   hb = thread_heap;
-  // oswrite(2,"yfree 2\n",8);
   ylog(Falloc,"yfree heap %p",(void *)hb);
 
-  if (hb == nil) {
-    error(__LINE__,Ffree,"free(%p) in empty heap was not malloc()ed",p);
-    return;
+  if (unlikely(hb == nil || ((size_t)hb & 1))) {
+    if (isboot(p)) return;
+    hb = setupheap(); // may be a block from another thread
+    if (hb == nil) return;
   }
+  if (unlikely(isboot(p))) return;
+#if Yal_enable_latency
+  ub8 t0 = ytsc();
+  hb->latpath = Yal_lat_free;
+  yfree_heap(hb,p,len);
+  latrec(hb,t0);
+#else
   yfree_heap(hb,p,len);
+#endif
 }
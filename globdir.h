@@ -0,0 +1,84 @@
+/* globdir.h - global region directory
+
+   This file is part of yalloc, yet another memory allocator with emphasis on efficiency and compactness.
+
+   SPDX-FileCopyrightText: © 2024 Joris van der Geer
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+  Global directory from page to owning region, or heap base for bump blocks, to find the owner of a block freed by another thread.
+  Three levels of tagged entries: a region or heap if the whole span belongs to it, else a lower table. Tables are never freed.
+  Each range is written only by its owning heap. Readers on any thread need no lock, as a live block's entry is stable.
+*/
+#define Gdir 9 // lower levels
+#define Gdirlen (1u << Gdir)
+#define Gdirtop (Maxvm - Pagebits - 2 * Gdir)
+
+#define Gtag_reg 1
+#define Gtag_heap 2
+#define Gtag_msk 3
+
+static _Atomic size_t globdir[1u << Gdirtop];
+
+// new lower table, filled with the entry it replaces
+static _Atomic size_t *gdir_table(size_t ent)
+{
+  _Atomic size_t *tab = osmmap(Gdirlen * sizeof(size_t));
+  ub4 i;
+
+  if (tab == nil) return nil;
+  if (ent) for (i = 0; i < Gdirlen; i++) atomic_store_explicit(tab + i,ent,memory_order_relaxed);
+  return tab;
+}
+
+// set pages org .. end in tab at level shift to val
+static bool gdir_fill(_Atomic size_t *tab,ub4 shift,ub4 msk,size_t org,size_t end,size_t val)
+{
+  size_t span = 1ul << shift;
+  size_t nxt,ent;
+  _Atomic size_t *slot,*sub;
+
+  while (org < end) {
+    slot = tab + ((org >> shift) & msk);
+    nxt = (org | (span - 1)) + 1;
+    ent = atomic_load_explicit(slot,memory_order_acquire);
+    if (shift == 0 || ent == 0 || (ent & Gtag_msk)) { // value or empty
+      if ( (org & (span - 1)) == 0 && nxt <= end) { // whole span
+        atomic_store_explicit(slot,val,memory_order_release);
+        org = nxt;
+        continue;
+      }
+      if (ent == val) { org = nxt; continue; }
+      sub = gdir_table(ent);
+      if (sub == nil) return 1;
+      if (atomic_compare_exchange_strong_explicit(slot,&ent,(size_t)sub,memory_order_acq_rel,memory_order_acquire) == 0) {
+        osmunmap((void *)sub,Gdirlen * sizeof(size_t)); // another heap added a table in the meantime
+        sub = (_Atomic size_t *)ent;
+      }
+    } else sub = (_Atomic size_t *)ent;
+    if (gdir_fill(sub,shift - Gdir,Gdirlen - 1,org,min(nxt,end),val)) return 1;
+    org = nxt;
+  }
+  return 0;
+}
+
+// enter or clear the pages of [bas,bas+len). returns 0 on success
+static bool gdir_set(size_t bas,size_t len,size_t val)
+{
+  size_t org = bas >> Pagebits;
+  size_t end = (bas + len + Page - 1) >> Pagebits;
+
+  return gdir_fill(globdir,2 * Gdir,(1u << Gdirtop) - 1,org,end,val);
+}
+
+// tagged region or heap for ip, 0 if none
+static size_t gdir_find(size_t ip)
+{
+  size_t pg = ip >> Pagebits;
+  size_t ent;
+
+  ent = atomic_load_explicit(globdir + ((pg >> (2 * Gdir)) & ((1u << Gdirtop) - 1)),memory_order_acquire);
+  if (ent == 0 || (ent & Gtag_msk)) return ent;
+  ent = atomic_load_explicit((_Atomic size_t *)ent + ((pg >> Gdir) & (Gdirlen - 1)),memory_order_acquire);
+  if (ent == 0 || (ent & Gtag_msk)) return ent;
+  return atomic_load_explicit((_Atomic size_t *)ent + (pg & (Gdirlen - 1)),memory_order_acquire);
+}
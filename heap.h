@@ -27,49 +27,94 @@ static heap *newheap(ub4 delcnt)
 {
   static _Atomic ub4 heapmem_pos;
 
-  static char Align(16) heapmem[Iniheap];
+  static char Align(Page) heapmem[Iniheap];
 
   char *cbase;
-  heap *base;
+  heap *base,*xbase;
   ub4 pos;
-  ub4 id;
+  ub4 id,inuse;
   ub4 hlen = sizeof(struct st_heap);
-  ub4 rlen = inireg * sizeof(region);
-  ub4 dlen = inidir * Dir * sizeof(region);
+  ub4 rlen,dlen,iofs;
   ub4 blen = Inimem;
-  ub4 len = hlen + rlen + dlen + blen;
+  ub4 len;
 
   sassert(Basealign >= 4,"Basealign >= 4");
 
+  if (unlikely(atomic_load_explicit(&conf_done,memory_order_acquire) != Conf_done)) yal_conf();
+
+  rlen = inireg * sizeof(region);
+  dlen = inidir * Dir * sizeof(region);
+  iofs = doalign(hlen + rlen + dlen,16u); // bump area 16-aligned, see yalloc_heap()
+  len = iofs + blen;
+
   id = atomic_fetch_add_explicit(&heap_gid,1,memory_order_relaxed);
 
   ylog(Fheap,"new heap id %u base %u + regs %u + dir %u = %u",id,hlen,rlen,dlen,len)
-  len = doalign(len,16u);
-  pos = atomic_fetch_add(&heapmem_pos,len);
-  atomic_fetch_and_explicit(&heapmem_pos,hi16,memory_order_relaxed); // avoid overflow
-  if (pos + len <= Iniheap) {
-    cbase = heapmem + pos;
-    base = (heap *)(void *)cbase;
-    base->iniheap = 1;
-  } else {
-    cbase = osmmap(len);
-    ylog(Fheap,"mmap for heap base = %p",(void *)cbase);
-    base = (heap *)(void *)cbase;
-    if (cbase == nil) return nil;
+  len = doalign(len,Page); // own pages in the global directory, for bump blocks
+
+  // adopt the heap of an exited thread including its blocks, or reuse a deleted heap base, keeping its stats
+  for (base = atomic_load_explicit(&heaplist,memory_order_acquire); base; base = base->nxt) {
+    inuse = atomic_load_explicit(&base->inuse,memory_order_relaxed);
+    if (inuse == Heap_orphan && atomic_compare_exchange_strong(&base->inuse,&inuse,Heap_inuse)) {
+      ylog(Fheap,"adopt heap %u base %p bump blocks %u",base->id,(void *)base,base->bumpcnt);
+      base->delcnt = delcnt;
+      if (base->bumpcnt == 0) base->inipos = 0; // all freed, e.g. by a short-lived thread
+      // numanode kept, as the adopted regions stay bound there and are reused by node
+      if (heap_keyok) pthread_setspecific(heap_key,base); // see heap_exit()
+      return base;
+    }
+    if (base->baselen < len || inuse != Heap_free) continue;
+    if (atomic_compare_exchange_strong(&base->inuse,&inuse,Heap_inuse) == 0) continue;
+    cbase = (char *)base;
+    len = base->baselen;
+    memset(cbase,0,offsetof(heap,stat));
+    memset(cbase + hlen,0,len - hlen);
+#if Yal_enable_prof
+    if (base->proftab) memset(base->proftab,0,sizeof(struct profent) << Prof_tab);
+    base->profcnt = 0;
+#endif
+    ylog(Fheap,"reuse heap base %p",(void *)cbase);
+    break;
+  }
+
+  if (base == nil) {
+    pos = atomic_load_explicit(&heapmem_pos,memory_order_relaxed); // claim only if it fits, bases may not overlap
+    while (pos + len <= Iniheap && atomic_compare_exchange_weak_explicit(&heapmem_pos,&pos,pos + len,memory_order_relaxed,memory_order_relaxed) == 0) ;
+    if (pos + len <= Iniheap) {
+      cbase = heapmem + pos;
+      base = (heap *)(void *)cbase;
+      base->iniheap = 1;
+    } else {
+      cbase = osmmap(len);
+      ylog(Fheap,"mmap for heap base = %p",(void *)cbase);
+      base = (heap *)(void *)cbase;
+      if (cbase == nil) return nil;
+    }
+    base->inuse = Heap_inuse;
+    xbase = atomic_load_explicit(&heaplist,memory_order_relaxed);
+    do base->nxt = xbase;
+    while (atomic_compare_exchange_weak_explicit(&heaplist,&xbase,base,memory_order_release,memory_order_relaxed) == 0);
   }
-  base->regmem = (region *)(void *)(cbase + hlen);
-  base->regmem_top = inireg;
+  base->regmem = base->regini = (region *)(void *)(cbase + hlen);
+  base->regmem_top = base->reginitop = inireg;
 
   base->dirmem = (struct direntry *)(void *)(cbase + hlen + rlen);
   base->dirmem_top = inidir;
 
-  base->inimem = cbase + hlen + rlen + dlen;
+  base->inimem = cbase + iofs;
 
   base->delcnt = delcnt;
   base->baselen = len;
   base->id = id;
+  base->mmap_threshold = mmap_threshold;
+#if Yal_enable_numa
+  if (numa_mode) base->numanode = osnumanode();
+#endif
   memset(base->len2tclas,0xff,sizeof(base->len2tclas));
   memset(base->tclas2clas,0xff,sizeof(base->tclas2clas));
+  memset(base->cal2clas,0xff,sizeof(base->cal2clas));
+  gdir_set((size_t)base,len,(size_t)base | Gtag_heap);
+  if (heap_keyok) pthread_setspecific(heap_key,base); // see heap_exit()
   return base;
 }
 
@@ -81,6 +126,12 @@ static void delheap(heap *hb,bool trim)
   region *reg,*xreg;
 
   if (hb->iniheap || (trim == 0 && delcnt > Heap_del_threshhold)) return; // prevent continuous delete-create cycles
+  if (hb->critical) return;
+
+  mmap_cache_trim(hb);
+#if Yal_enable_trace
+  if (hb->tracering) trace_drain(hb,hb->tracering);
+#endif
 
   reg = hb->nxtregs;
   while (reg) {
@@ -91,8 +142,31 @@ static void delheap(heap *hb,bool trim)
 
   delcnt = (delcnt + 1) & hi24;
   x = (delcnt << 1) | 1;
-  thread_heap = (heap *)x;
-  osunmem(__LINE__,Fheap,hb,hb,hb->baselen,"heap base");
+  if (hb == thread_heap) thread_heap = (heap *)x; // else an exited thread's heap, see orphan_drain()
+  atomic_store_explicit(&hb->inuse,Heap_free,memory_order_release); // base available for reuse
+}
+
+/* At thread exit, via a pthread key destructor: drain and release the heap, leaving its blocks in place.
+   The heap is then drained by remote frees, and adopted as is by the next new thread.
+ */
+static void heap_exit(void *arg)
+{
+  heap *hb = arg;
+
+  if (hb != thread_heap) return; // deleted meanwhile
+
+  if (hb->critical) yal_critical(0);
+  remote_drain(hb);
+  mmap_cache_trim(hb);
+#if Yal_enable_trace
+  if (hb->tracering) trace_drain(hb,hb->tracering);
+#endif
+  ylog(Fheap,"heap %u thread exit",hb->id);
+  thread_heap = nil; // a later call from another destructor sets up a heap again
+
+  atomic_store_explicit(&hb->inuse,Heap_orphan,memory_order_release);
+  atomic_thread_fence(memory_order_seq_cst); // against remote_free()
+  if (atomic_load_explicit(&hb->remote,memory_order_relaxed) || atomic_load_explicit(&hb->remotetiny,memory_order_relaxed)) orphan_drain(hb);
 }
 
 static heap *getheap(void)
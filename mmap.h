@@ -0,0 +1,89 @@
+/* mmap.h - cache of released mmap blocks and adaptive mmap threshold
+
+   This file is part of yalloc, yet another memory allocator with emphasis on efficiency and compactness.
+
+   SPDX-FileCopyrightText: © 2024 Joris van der Geer
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+  Freed mmap blocks are kept in a small per-heap cache in LRU order, bounded by count and bytes. New mmap blocks of similar size reuse them.
+  A cache hit means a block size recurs. The heap's mmap threshold is then raised above it, glibc style, unless the threshold was set explicitly.
+  An explicit threshold, via mallopt() or YALLOC_CONF, applies to all heaps including existing ones.
+*/
+
+// effective mmap threshold of heap hb
+static size_t mmap_limit(const heap *hb)
+{
+  return mmap_dynamic ? hb->mmap_threshold : mmap_threshold;
+}
+
+// keep a released mapping. returns 0 if not cached
+static bool mmap_cache_put(heap *hb,void *p,size_t len)
+{
+  struct mmapcache *mc = hb->mmcache;
+  ub4 cnt = hb->mmcachecnt;
+  ub4 i;
+
+  if (len > mmap_cache_max || hb->critical) return 0;
+
+  // evict least recently used
+  while (cnt && (cnt == Mmap_cache || hb->mmcachelen + len > mmap_cache_max)) {
+    cnt--;
+    hb->mmcachelen -= mc[cnt].len;
+    osunmem(__LINE__,Fmmap,hb,mc[cnt].p,mc[cnt].len,"mmap cache");
+    ystatdec(hb,mapuser,mc[cnt].len)
+    atomic_fetch_sub_explicit(&global_mapcnt,1,memory_order_relaxed);
+  }
+
+  for (i = cnt; i; i--) mc[i] = mc[i - 1];
+  mc[0].p = p;
+  mc[0].len = len;
+  hb->mmcachecnt = cnt + 1;
+  hb->mmcachelen += len;
+  ylog(Fmmap,"heap %u cache %p %zu`b cnt %u",hb->id,p,len,cnt + 1);
+  return 1;
+}
+
+// most recent mapping of at least len and at most 1/8 larger
+static void *mmap_cache_get(heap *hb,size_t len,size_t *plen)
+{
+  struct mmapcache *mc = hb->mmcache;
+  ub4 cnt = hb->mmcachecnt;
+  ub4 i;
+  size_t n;
+  void *p;
+
+  for (i = 0; i < cnt; i++) {
+    n = mc[i].len;
+    if (n >= len && n - len <= (len >> 3)) break;
+  }
+  if (i == cnt) {
+    ystat(hb,mmcachemiss)
+    return nil;
+  }
+  p = mc[i].p;
+  for (; i + 1 < cnt; i++) mc[i] = mc[i + 1];
+  hb->mmcachecnt = cnt - 1;
+  hb->mmcachelen -= n;
+  ystat(hb,mmcachehit)
+  *plen = n;
+
+  if (mmap_dynamic && len >= hb->mmap_threshold && len < Mmap_dyn_max) { // recurring size
+    hb->mmap_threshold = len + Page;
+    ylog(Fmmap,"heap %u mmap threshold %zu`b",hb->id,hb->mmap_threshold);
+  }
+  return p;
+}
+
+static void mmap_cache_trim(heap *hb)
+{
+  struct mmapcache *mc = hb->mmcache;
+  ub4 i;
+
+  for (i = 0; i < hb->mmcachecnt; i++) {
+    osunmem(__LINE__,Fmmap,hb,mc[i].p,mc[i].len,"mmap cache");
+    ystatdec(hb,mapuser,mc[i].len)
+    atomic_fetch_sub_explicit(&global_mapcnt,1,memory_order_relaxed);
+  }
+  hb->mmcachecnt = 0;
+  hb->mmcachelen = 0;
+}
@@ -0,0 +1,359 @@
+/* mtbench.c - multi-threaded scalability benchmark, yalloc against the system allocator
+
+   This file is part of yalloc, yet another memory allocator with emphasis on efficiency and compactness.
+
+   SPDX-FileCopyrightText: © 2024 Joris van der Geer
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   usage: mtbench [-c] [-a yalloc|libc] [-n ops] [-t threads] [workload ...]
+   -c  - csv output
+   -a  - only run given allocator
+   -n  - ops per thread, default 1M
+   -t  - max threads, default #cpus. Runs 1,2,4 .. threads
+
+   Workloads:
+   larson   - random replacement in a slot array. Arrays rotate between threads each epoch, thus most frees are remote
+   local    - random replacement in a thread-local slot array
+   prodcons - producer threads allocate, paired consumer threads free
+   churn    - threads repeatedly create short-lived threads that allocate and free
+   exit     - threads repeatedly create short-lived threads that allocate and exit, then free their blocks including an mmap one
+
+   Reported per run: throughput, throughput per core used, resident set at the end while the slot arrays are still held,
+   minor page faults, and for yalloc the #mmap, munmap and mremap calls. Each thread frees the slot array it wrote last.
+   For yalloc, each run also checks that all mmap blocks are released and no heap stays in use after its thread exited.
+*/
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "base.h"
+
+#include "bench.h"
+
+#define Slots 1024
+#define Epochs 8
+#define Ring 1024 // producer-consumer queue
+#define Churnops 256 // per short-lived thread
+#define Exitbig (1ul << 26) // above the adaptive mmap threshold
+
+struct ring {
+  _Atomic size_t head,tail;
+  _Atomic(void *) q[Ring];
+};
+
+struct targ {
+  const struct allocator *ap;
+  ub4 id,nthr;
+  size_t ops;
+  size_t done;
+  void **slots; // all threads' slot arrays
+  struct ring *rings;
+  pthread_barrier_t *bar;
+};
+
+static size_t resident;
+
+static size_t rss(void)
+{
+  FILE *fp = fopen("/proc/self/statm","r");
+  unsigned long size = 0,res = 0;
+
+  if (fp == nil) return 0;
+  if (fscanf(fp,"%lu %lu",&size,&res) != 2) res = 0;
+  fclose(fp);
+  return res * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+// sample rss while all blocks are held, then free the given slot array from its last writer
+static void finish(struct targ *ta,void **slots)
+{
+  ub4 k;
+
+  pthread_barrier_wait(ta->bar);
+  if (ta->id == 0) resident = rss();
+  pthread_barrier_wait(ta->bar);
+  if (slots == nil) return;
+  for (k = 0; k < Slots; k++) ta->ap->free(slots[k]);
+}
+
+static ub4 xrand(ub4 *rnd)
+{
+  ub4 x = *rnd;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *rnd = x;
+  return x;
+}
+
+static void *larson(void *arg)
+{
+  struct targ *ta = arg;
+  const struct allocator *ap = ta->ap;
+  void **slots;
+  size_t i,n = ta->ops / Epochs;
+  ub4 rnd = ta->id + 1;
+  ub4 epoch,k;
+
+  for (epoch = 0; epoch < Epochs; epoch++) {
+    slots = ta->slots + ((ta->id + epoch) % ta->nthr) * Slots; // filled by another thread in the previous epoch
+    for (i = 0; i < n; i++) {
+      k = xrand(&rnd) % Slots;
+      ap->free(slots[k]);
+      slots[k] = ap->malloc(16 + xrand(&rnd) % 496);
+    }
+    pthread_barrier_wait(ta->bar);
+  }
+  ta->done = n * Epochs;
+  finish(ta,slots);
+  return nil;
+}
+
+static void *local(void *arg)
+{
+  struct targ *ta = arg;
+  const struct allocator *ap = ta->ap;
+  void **slots = ta->slots + ta->id * Slots;
+  size_t i;
+  ub4 rnd = ta->id + 1;
+  ub4 k;
+
+  for (i = 0; i < ta->ops; i++) {
+    k = xrand(&rnd) % Slots;
+    ap->free(slots[k]);
+    slots[k] = ap->malloc(8 + xrand(&rnd) % 1024);
+  }
+  ta->done = ta->ops;
+  finish(ta,slots);
+  return nil;
+}
+
+// even ids produce into ring id/2, odd ids consume from it
+static void *prodcons(void *arg)
+{
+  struct targ *ta = arg;
+  const struct allocator *ap = ta->ap;
+  struct ring *rp = ta->rings + ta->id / 2;
+  size_t i,pos;
+  ub4 rnd = ta->id + 1;
+  void *p;
+
+  if (ta->id & 1) {
+    for (i = 0; i < ta->ops; i++) {
+      pos = atomic_load_explicit(&rp->head,memory_order_relaxed);
+      while (atomic_load_explicit(&rp->tail,memory_order_acquire) == pos) sched_yield();
+      p = atomic_load_explicit(rp->q + (pos & (Ring - 1)),memory_order_relaxed);
+      atomic_store_explicit(&rp->head,pos + 1,memory_order_release);
+      ap->free(p);
+    }
+  } else {
+    for (i = 0; i < ta->ops; i++) {
+      p = ap->malloc(16 + xrand(&rnd) % 496);
+      pos = atomic_load_explicit(&rp->tail,memory_order_relaxed);
+      while (pos - atomic_load_explicit(&rp->head,memory_order_acquire) >= Ring) sched_yield();
+      atomic_store_explicit(rp->q + (pos & (Ring - 1)),p,memory_order_relaxed);
+      atomic_store_explicit(&rp->tail,pos + 1,memory_order_release);
+    }
+  }
+  ta->done = ta->ops;
+  finish(ta,nil);
+  return nil;
+}
+
+static void *churn_child(void *arg)
+{
+  struct targ *ta = arg;
+  const struct allocator *ap = ta->ap;
+  void *ptrs[Churnops];
+  ub4 rnd = (ub4)ta->done + ta->id + 1;
+  ub4 i;
+
+  for (i = 0; i < Churnops; i++) ptrs[i] = ap->malloc(8 + xrand(&rnd) % 256);
+  for (i = 0; i < Churnops; i++) ap->free(ptrs[i]);
+  return nil;
+}
+
+static void *churn(void *arg)
+{
+  struct targ *ta = arg;
+  pthread_t tid;
+  size_t n = max(ta->ops / (Churnops * 16),4);
+
+  for (ta->done = 0; ta->done < n * Churnops; ta->done += Churnops) {
+    if (pthread_create(&tid,nil,churn_child,ta)) break;
+    pthread_join(tid,nil);
+  }
+  finish(ta,nil);
+  return nil;
+}
+
+// allocate into the parent's slot array and exit
+static void *exit_child(void *arg)
+{
+  struct targ *ta = arg;
+  const struct allocator *ap = ta->ap;
+  void **slots = ta->slots + ta->id * Slots;
+  ub4 rnd = (ub4)ta->done + ta->id + 1;
+  ub4 k;
+  char *p;
+
+  for (k = 0; k < Slots - 1; k++) slots[k] = ap->malloc(8 + xrand(&rnd) % 512);
+  p = ap->malloc(Exitbig);
+  if (p) *p = 1;
+  slots[k] = p;
+  return nil;
+}
+
+// free blocks of threads that have exited
+static void *exitfree(void *arg)
+{
+  struct targ *ta = arg;
+  const struct allocator *ap = ta->ap;
+  void **slots = ta->slots + ta->id * Slots;
+  pthread_t tid;
+  size_t n = max(ta->ops / (Slots * 16),4);
+  ub4 k;
+
+  for (ta->done = 0; ta->done < n * Slots; ta->done += Slots) {
+    if (pthread_create(&tid,nil,exit_child,ta)) break;
+    pthread_join(tid,nil);
+    for (k = 0; k < Slots; k++) ap->free(slots[k]);
+  }
+  finish(ta,nil);
+  return nil;
+}
+
+static const struct workload {
+  cchar *name;
+  void *(*fn)(void *arg);
+  ub4 minthr;
+} workloads[] = {
+  { "larson",larson,1 },
+  { "local",local,1 },
+  { "prodcons",prodcons,2 },
+  { "churn",churn,1 },
+  { "exit",exitfree,1 }
+};
+
+#define Wcnt (sizeof(workloads) / sizeof(workloads[0]))
+
+static int csv;
+static ub4 ncpu;
+
+static int fails;
+
+static void run(const struct allocator *ap,const struct workload *wp,ub4 nthr,size_t ops)
+{
+  pthread_t tids[256];
+  struct targ targs[256];
+  pthread_barrier_t bar;
+  struct rusage ru0,ru1;
+  struct yal_stats st0,st1;
+  void **slots;
+  struct ring *rings;
+  size_t done = 0;
+  size_t oscalls,minflt;
+  double sec,opsec;
+  ub4 t,cores;
+  ub8 t0,ns;
+
+  if (nthr < wp->minthr) return;
+  if (wp->minthr == 2) nthr &= ~1u;
+
+  slots = calloc((size_t)nthr * Slots,sizeof(void *));
+  rings = calloc(nthr,sizeof(struct ring));
+  if (slots == nil || rings == nil) { fprintf(stderr,"out of memory\n"); exit(1); }
+  pthread_barrier_init(&bar,nil,nthr);
+
+  yal_stats(&st0,1);
+  getrusage(RUSAGE_SELF,&ru0);
+  t0 = nsnow();
+
+  for (t = 0; t < nthr; t++) {
+    targs[t] = (struct targ){ .ap = ap, .id = t, .nthr = nthr, .ops = ops, .slots = slots, .rings = rings, .bar = &bar };
+    if (pthread_create(tids + t,nil,wp->fn,targs + t)) { fprintf(stderr,"cannot create thread: %m\n"); exit(1); }
+  }
+  for (t = 0; t < nthr; t++) {
+    pthread_join(tids[t],nil);
+    done += targs[t].done;
+  }
+
+  ns = nsnow() - t0;
+  getrusage(RUSAGE_SELF,&ru1);
+  yal_stats(&st1,1);
+
+  free(slots);
+  free(rings);
+  pthread_barrier_destroy(&bar);
+
+  sec = (double)ns / 1e9;
+  opsec = (double)done / sec;
+  cores = min(nthr,ncpu);
+  minflt = (size_t)(ru1.ru_minflt - ru0.ru_minflt);
+  oscalls = ap->malloc == yal_malloc ? st1.oscalls - st0.oscalls : 0;
+
+  if (csv) printf("%s,%s,%u,%zu,%.4f,%.0f,%.0f,%zu,%zu,%zu\n",ap->name,wp->name,nthr,done,sec,opsec,opsec / cores,resident,minflt,oscalls);
+  else printf("%-8s %-9s %3u thr %10zu ops %8.3f s %9.2f Mop/s %8.2f Mop/s/core rss %6zu MiB %8zu faults %8zu oscalls\n",
+    ap->name,wp->name,nthr,done,sec,opsec / 1e6,opsec / cores / 1e6,resident >> 20,minflt,oscalls);
+  fflush(stdout);
+
+  if (ap->malloc != yal_malloc) return;
+  if (st1.mmaplen != st0.mmaplen) { fprintf(stderr,"%s: %zu bytes in mmap blocks not released\n",wp->name,st1.mmaplen - st0.mmaplen); fails++; }
+  if (st1.heaps > st0.heaps) { fprintf(stderr,"%s: %zu heaps still in use after their threads exited\n",wp->name,st1.heaps - st0.heaps); fails++; }
+}
+
+static int usage(void)
+{
+  ub4 w;
+
+  fprintf(stderr,"usage: mtbench [-c] [-a yalloc|libc] [-n ops] [-t threads] [workload ...]\nworkloads:");
+  for (w = 0; w < Wcnt; w++) fprintf(stderr," %s",workloads[w].name);
+  fprintf(stderr,"\n");
+  return 1;
+}
+
+int main(int argc,char *argv[])
+{
+  cchar *only = nil;
+  size_t ops = 1000000;
+  ub4 a,w,nthr,maxthr;
+  int i,sel;
+
+  ncpu = (ub4)sysconf(_SC_NPROCESSORS_ONLN);
+  maxthr = ncpu;
+
+  while (argc > 1 && argv[1][0] == '-') {
+    if (strcmp(argv[1],"-c") == 0) csv = 1;
+    else if (strcmp(argv[1],"-a") == 0 && argc > 2) { only = argv[2]; argc--; argv++; }
+    else if (strcmp(argv[1],"-n") == 0 && argc > 2) { ops = strtoul(argv[2],nil,10); argc--; argv++; }
+    else if (strcmp(argv[1],"-t") == 0 && argc > 2) { maxthr = (ub4)strtoul(argv[2],nil,10); argc--; argv++; }
+    else return usage();
+    argc--; argv++;
+  }
+  if (ops < Epochs || maxthr == 0 || maxthr > 256) return usage();
+
+  if (csv) printf("alloc,workload,threads,ops,sec,ops_per_sec,ops_per_sec_core,rss,minflt,oscalls\n");
+
+  for (w = 0; w < Wcnt; w++) {
+    sel = argc < 2;
+    for (i = 1; i < argc; i++) if (strcmp(argv[i],workloads[w].name) == 0) sel = 1;
+    if (sel == 0) continue;
+    for (nthr = 1; nthr <= maxthr; nthr = nthr < maxthr && nthr * 2 > maxthr ? maxthr : nthr * 2) {
+      for (a = 0; a < Acnt; a++) {
+        if (only && strcmp(only,allocators[a].name)) continue;
+        run(allocators + a,workloads + w,nthr,ops);
+      }
+      if (nthr == maxthr) break;
+    }
+  }
+  return fails != 0;
+}
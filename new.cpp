@@ -0,0 +1,109 @@
+/* new.cpp - C++ operator new and delete
+
+   This file is part of yalloc, yet another memory allocator with emphasis on efficiency and compactness.
+
+   SPDX-FileCopyrightText: © 2024 Joris van der Geer
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+  Replaces all global operator new and delete overloads. Link with yalloc.o
+  Plain new goes to the heap directly, aligned new to the aligned path, and sized delete to the sized free path.
+  On failure, the new-handler is called until it either frees memory or throws. Without a handler std::bad_alloc is thrown.
+  nothrow variants return nullptr instead.
+*/
+
+#include <cstddef>
+#include <new>
+
+#include "yalloc.h"
+
+static void *newfail(std::size_t len,std::size_t align)
+{
+  void *p;
+  std::new_handler handler;
+
+  for (;;) {
+    handler = std::get_new_handler();
+    if (handler == nullptr) throw std::bad_alloc();
+    handler();
+    p = align ? yal_new_aligned(align,len) : yal_new(len);
+    if (p) return p;
+  }
+}
+
+static void *newnothrow(std::size_t len,std::size_t align) noexcept
+{
+  try {
+    return newfail(len,align);
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+static inline void *ynew(std::size_t len)
+{
+  void *p = yal_new(len);
+
+  if (__builtin_expect(p != nullptr,1)) return p;
+  return newfail(len,0);
+}
+
+static inline void *ynew_aligned(std::size_t len,std::align_val_t al)
+{
+  std::size_t align = static_cast<std::size_t>(al);
+  void *p = yal_new_aligned(align,len);
+
+  if (__builtin_expect(p != nullptr,1)) return p;
+  return newfail(len,align);
+}
+
+static inline void *ynew_nothrow(std::size_t len) noexcept
+{
+  void *p = yal_new(len);
+
+  if (__builtin_expect(p != nullptr,1)) return p;
+  return newnothrow(len,0);
+}
+
+static inline void *ynew_aligned_nothrow(std::size_t len,std::align_val_t al) noexcept
+{
+  std::size_t align = static_cast<std::size_t>(al);
+  void *p = yal_new_aligned(align,len);
+
+  if (__builtin_expect(p != nullptr,1)) return p;
+  return newnothrow(len,align);
+}
+
+// -- new --
+
+void *operator new(std::size_t len) { return ynew(len); }
+void *operator new[](std::size_t len) { return ynew(len); }
+
+void *operator new(std::size_t len,const std::nothrow_t &) noexcept { return ynew_nothrow(len); }
+void *operator new[](std::size_t len,const std::nothrow_t &) noexcept { return ynew_nothrow(len); }
+
+void *operator new(std::size_t len,std::align_val_t al) { return ynew_aligned(len,al); }
+void *operator new[](std::size_t len,std::align_val_t al) { return ynew_aligned(len,al); }
+
+void *operator new(std::size_t len,std::align_val_t al,const std::nothrow_t &) noexcept { return ynew_aligned_nothrow(len,al); }
+void *operator new[](std::size_t len,std::align_val_t al,const std::nothrow_t &) noexcept { return ynew_aligned_nothrow(len,al); }
+
+// -- delete --
+
+void operator delete(void *p) noexcept { yal_delete(p,0); }
+void operator delete[](void *p) noexcept { yal_delete(p,0); }
+
+void operator delete(void *p,std::size_t len) noexcept { yal_delete(p,len); }
+void operator delete[](void *p,std::size_t len) noexcept { yal_delete(p,len); }
+
+void operator delete(void *p,const std::nothrow_t &) noexcept { yal_delete(p,0); }
+void operator delete[](void *p,const std::nothrow_t &) noexcept { yal_delete(p,0); }
+
+// aligned blocks may be larger than requested, thus free unsized
+void operator delete(void *p,std::align_val_t) noexcept { yal_delete(p,0); }
+void operator delete[](void *p,std::align_val_t) noexcept { yal_delete(p,0); }
+
+void operator delete(void *p,std::size_t,std::align_val_t) noexcept { yal_delete(p,0); }
+void operator delete[](void *p,std::size_t,std::align_val_t) noexcept { yal_delete(p,0); }
+
+void operator delete(void *p,std::align_val_t,const std::nothrow_t &) noexcept { yal_delete(p,0); }
+void operator delete[](void *p,std::align_val_t,const std::nothrow_t &) noexcept { yal_delete(p,0); }
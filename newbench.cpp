@@ -0,0 +1,180 @@
+/* newbench.cpp - node-based container workloads through operator new
+
+   This file is part of yalloc, yet another memory allocator with emphasis on efficiency and compactness.
+
+   SPDX-FileCopyrightText: © 2024 Joris van der Geer
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   usage: newbench [-c] [-n ops]
+   -c  - csv output, same columns as bench
+   -n  - elements per case, default 1M
+
+   Built twice: newbench links new.o and yalloc.o, newbench_sys uses the system allocator.
+   Operator new cannot be replaced per call site, thus the comparison is between the two binaries.
+   Exits nonzero if operator new returns a block below the default new alignment.
+*/
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "yalloc.h"
+
+extern "C" void *yal_new(std::size_t len) __attribute__ ((weak));
+
+static const char *allocname;
+static int csv;
+
+typedef std::uint64_t ub8;
+
+static ub8 nsnow()
+{
+  return (ub8)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void report(const char *cas,std::size_t arg,std::size_t ops,ub8 ns)
+{
+  double nsop = ops ? (double)ns / (double)ops : 0;
+  double opsec = ns ? (double)ops * 1e9 / (double)ns : 0;
+
+  if (csv) std::printf("%s,%s,%zu,%zu,%lu,%.2f,%.0f\n",allocname,cas,arg,ops,(unsigned long)ns,nsop,opsec);
+  else std::printf("%-8s %-16s %9zu %10zu ops %9.2f ns/op %9.2f Mop/s\n",allocname,cas,arg,ops,nsop,opsec / 1e6);
+  std::fflush(stdout);
+}
+
+static ub8 xrand(ub8 &x)
+{
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return x;
+}
+
+static void bench_map(std::size_t n)
+{
+  std::map<ub8,ub8> m;
+  ub8 rnd = 1,sum = 0;
+  ub8 t0;
+  std::size_t i;
+
+  t0 = nsnow();
+  for (i = 0; i < n; i++) m.emplace(xrand(rnd),i);
+  report("map insert",n,n,nsnow() - t0);
+
+  rnd = 1;
+  t0 = nsnow();
+  for (i = 0; i < n; i++) sum += m.find(xrand(rnd))->second;
+  report("map find",n,n,nsnow() - t0);
+
+  rnd = 1;
+  t0 = nsnow();
+  for (i = 0; i < n; i++) m.erase(xrand(rnd));
+  report("map erase",n,n,nsnow() - t0);
+  if (sum == 1) std::printf(" ");
+}
+
+// fixed population, random replacement
+static void bench_map_churn(std::size_t n)
+{
+  std::map<ub8,ub8> m;
+  std::vector<ub8> keys(65536);
+  ub8 rnd = 7;
+  ub8 t0;
+  std::size_t i,k;
+
+  for (i = 0; i < keys.size(); i++) m.emplace(keys[i] = xrand(rnd),i);
+
+  t0 = nsnow();
+  for (i = 0; i < n; i++) {
+    k = xrand(rnd) & (keys.size() - 1);
+    m.erase(keys[k]);
+    m.emplace(keys[k] = xrand(rnd),i);
+  }
+  report("map churn",keys.size(),n,nsnow() - t0);
+}
+
+// heap-allocated string values beside the nodes and bucket array
+static void bench_umap(std::size_t n)
+{
+  std::unordered_map<ub8,std::string> m;
+  ub8 rnd = 3;
+  ub8 t0;
+  std::size_t i;
+
+  t0 = nsnow();
+  for (i = 0; i < n; i++) m.emplace(xrand(rnd),std::string(24 + (i & 31),'x'));
+  report("umap insert",n,n,nsnow() - t0);
+
+  rnd = 3;
+  t0 = nsnow();
+  for (i = 0; i < n; i++) m.erase(xrand(rnd));
+  report("umap erase",n,n,nsnow() - t0);
+}
+
+static void bench_umap_churn(std::size_t n)
+{
+  std::unordered_map<ub8,std::string> m;
+  std::vector<ub8> keys(65536);
+  ub8 rnd = 5;
+  ub8 t0;
+  std::size_t i,k;
+
+  m.reserve(keys.size());
+  for (i = 0; i < keys.size(); i++) m.emplace(keys[i] = xrand(rnd),std::string(40,'y'));
+
+  t0 = nsnow();
+  for (i = 0; i < n; i++) {
+    k = xrand(rnd) & (keys.size() - 1);
+    m.erase(keys[k]);
+    m.emplace(keys[k] = xrand(rnd),std::string(24 + (i & 63),'z'));
+  }
+  report("umap churn",keys.size(),n,nsnow() - t0);
+}
+
+// operator new is to return __STDCPP_DEFAULT_NEW_ALIGNMENT__ aligned blocks for all lengths
+static int check_align()
+{
+  std::vector<char *> blks;
+  std::size_t len;
+  int fails = 0;
+
+  for (len = 1; len <= 4096; len += len < 64 ? 1 : 61) {
+    char *p = new char[len];
+
+    if ((std::uintptr_t)p % __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+      std::fprintf(stderr,"new char[%zu] = %p not aligned to %zu\n",len,(void *)p,(std::size_t)__STDCPP_DEFAULT_NEW_ALIGNMENT__);
+      fails++;
+    }
+    blks.push_back(p);
+  }
+  for (char *p : blks) delete[] p;
+  return fails;
+}
+
+int main(int argc,char *argv[])
+{
+  std::size_t n = 1000000;
+
+  while (argc > 1 && argv[1][0] == '-') {
+    if (std::strcmp(argv[1],"-c") == 0) csv = 1;
+    else if (std::strcmp(argv[1],"-n") == 0 && argc > 2) { n = std::strtoul(argv[2],nullptr,10); argc--; argv++; }
+    else { std::fprintf(stderr,"usage: newbench [-c] [-n ops]\n"); return 1; }
+    argc--; argv++;
+  }
+
+  allocname = yal_new ? "yalloc" : "system";
+  if (check_align()) return 1;
+  if (csv) std::printf("alloc,case,arg,ops,ns,ns_per_op,ops_per_sec\n");
+
+  bench_map(n);
+  bench_map_churn(n);
+  bench_umap(n);
+  bench_umap_churn(n);
+  return 0;
+}
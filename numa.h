@@ -0,0 +1,61 @@
+/* numa.h - numa placement
+
+   This file is part of yalloc, yet another memory allocator with emphasis on efficiency and compactness.
+
+   SPDX-FileCopyrightText: © 2024 Joris van der Geer
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+  In numa mode, each heap records the node of its creating thread. Region user and meta memory is bound to that node before first touch.
+  Memory retained from deleted regions is only reused for the same node.
+  Works unchanged on single-node systems and with numa=fake
+*/
+
+void yal_numa(int on)
+{
+  heap *hb;
+
+  numa_mode = (on != 0);
+  hb = thread_heap;
+  if (on && hb && ((size_t)hb & 1) == 0) hb->numanode = osnumanode();
+}
+
+int yal_numa_node(int node)
+{
+  heap *hb = getheap();
+
+  if (hb == nil) return -1;
+  if (node >= 0 && (unsigned int)node < osnumacnt()) {
+    hb->numanode = (ub4)node;
+    ylog(Fnuma,"heap %u node %d",hb->id,node);
+  }
+  return (int)hb->numanode;
+}
+
+void *yal_alloc_interleaved(size_t len)
+{
+  heap *hb = getheap();
+  size_t n = doalign(len,Page);
+  void *p;
+  region *reg;
+
+  if (hb == nil) return nil;
+  if (len == 0 || len > (Maxvmsiz >> 2)) return oom(__LINE__,Fnuma,len,1);
+
+  p = osmem(__LINE__,Fnuma,hb,n,"interleaved block");
+  if (p == nil) return nil;
+  if (osmbind(p,n,-1)) ylog(Fnuma,"heap %u interleave %zu`b failed",hb->id,n);
+  atomic_fetch_add_explicit(&global_mapcnt,1,memory_order_relaxed);
+  ystatn(hb,mapuser,n)
+  ystat(hb,mmap)
+  ylat(hb,Yal_lat_mmap)
+  ystatn(hb,mmaplen,n)
+
+  reg = newregion(hb,p,n,0,Rmmap);
+  if (reg == nil) {
+    osunmem(__LINE__,Fnuma,hb,p,n,"interleaved block");
+    return nil;
+  }
+  reg->clas = Noclass;
+  reg->len = n;
+  return p;
+}
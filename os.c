@@ -15,6 +15,7 @@
 #endif
 
 #include <unistd.h>
+#include <fcntl.h>
 
 #include <string.h>
 
@@ -23,6 +24,22 @@ int oswrite(int fd,const char *buf,size_t len)
   return write(fd,buf,len);
 }
 
+#include <sys/uio.h>
+
+// gather write in one call, keeping chunks from different threads intact
+int oswritev(int fd,const void **bufs,const size_t *lens,int cnt)
+{
+  struct iovec iov[4];
+  int i;
+
+  if (cnt > 4) cnt = 4;
+  for (i = 0; i < cnt; i++) {
+    iov[i].iov_base = (void *)bufs[i];
+    iov[i].iov_len = lens[i];
+  }
+  return (int)writev(fd,iov,cnt);
+}
+
 static _Bool reserve = 1;
 
 #if defined (__unix__) || (defined (__APPLE__) && defined (__MACH__))
@@ -59,17 +76,61 @@ void *osmremap(void *p,size_t orglen,size_t newlen)
   void *np;
 #ifdef __linux__
   np = mremap(p,orglen,newlen,MREMAP_MAYMOVE);
-  if (p == MAP_FAILED) {
+  if (np == MAP_FAILED) {
     return NULL;
   }
-  return p;
+  return np;
 #else
+  if (newlen <= orglen) {
+    munmap((char *)p + newlen,orglen - newlen);
+    return p;
+  }
   np = osmmap(newlen);
-  if (np) memcpy(np,p,orglen);
+  if (np == NULL) return NULL;
+  memcpy(np,p,orglen);
   munmap(p,orglen);
   return np;
 #endif
+}
+
+// grow or shrink without moving, NULL if the range above is taken
+void *osmremap_fixed(void *p,size_t orglen,size_t newlen)
+{
+#ifdef __linux__
+  if (mremap(p,orglen,newlen,0) == MAP_FAILED) return NULL;
+  return p;
+#else
+  if (newlen > orglen) return NULL;
+  munmap((char *)p + newlen,orglen - newlen);
+  return p;
+#endif
+}
+
+// move the pages of p into a new mapping of newlen, and refill the vacated range with fresh pages
+// used to take a block out of a larger region without copying
+void *osmremap_move(void *p,size_t orglen,size_t newlen)
+{
+#ifdef __linux__
+  void *np,*fp;
+
+  np = osmmap(newlen);
+  if (np == NULL) return NULL;
+
+  if (mremap(p,orglen,orglen,MREMAP_MAYMOVE | MREMAP_FIXED,np) == MAP_FAILED) {
+    munmap(np,newlen);
+    return NULL;
+  }
+
+  fp = mmap(p,orglen,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANON | MAP_FIXED,-1,0);
+  if (fp == MAP_FAILED) { // put back
+    mremap(np,orglen,orglen,MREMAP_MAYMOVE | MREMAP_FIXED,p);
+    munmap(np,newlen);
+    return NULL;
+  }
   return np;
+#else
+  return NULL;
+#endif
 }
 
 void osmunmap(void *p,size_t len)
@@ -77,6 +138,141 @@ void osmunmap(void *p,size_t len)
   munmap(p,len);
 }
 
+// create or truncate for writing, e.g. a trace file
+int oscreate(const char *path)
+{
+  return open(path,O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,0644);
+}
+
+// copy file contents to fd, e.g. /proc/self/maps. No allocation
+int oscopyfile(int fd,const char *path)
+{
+  char buf[4096];
+  ssize_t n;
+  int ifd = open(path,O_RDONLY);
+
+  if (ifd == -1) return -1;
+  while ( (n = read(ifd,buf,sizeof(buf))) > 0) {
+    if (write(fd,buf,(size_t)n) != n) break;
+  }
+  close(ifd);
+  return n == 0 ? 0 : -1;
+}
+
+int osmlock(void *p,size_t len)
+{
+  return mlock(p,len);
+}
+
+// fault in pages of a fresh mapping
+void osprefault(void *p,size_t len)
+{
+  volatile char *cp = p;
+  size_t ofs;
+
+ #if defined __linux__ && defined MADV_POPULATE_WRITE
+  if (madvise(p,len,MADV_POPULATE_WRITE) == 0) return;
+ #endif
+  for (ofs = 0; ofs < len; ofs += 4096) cp[ofs] = cp[ofs];
+}
+
+// last-level cache size, 0 if unknown
+size_t oscachelen(void)
+{
+  long len = 0;
+
+#if defined _SC_LEVEL3_CACHE_SIZE
+  len = sysconf(_SC_LEVEL3_CACHE_SIZE);
+  if (len <= 0) len = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+  return len > 0 ? (size_t)len : 0;
+}
+
+// discard the pages, next access reads zeroes. returns 0 on success
+int ospurge(void *p,size_t len)
+{
+#ifdef __linux__
+  return madvise(p,len,MADV_DONTNEED);
+#else
+  return -1; // e.g. BSD MADV_DONTNEED may keep the contents
+#endif
+}
+
+#include <sched.h>
+
+void osyield(void)
+{
+  sched_yield();
+}
+
+// numa, via raw syscalls to avoid a libnuma dependency
+
+#ifdef __linux__
+ #include <sys/syscall.h>
+
+ #define Mpol_bind 2
+ #define Mpol_interleave 3
+ #define Maxnode 64
+
+static unsigned int numacnt;
+
+// number of possible nodes, from sysfs e.g. '0-1'
+unsigned int osnumacnt(void)
+{
+  char buf[64];
+  int fd;
+  ssize_t n;
+  unsigned int i,cnt = 0;
+
+  if (numacnt) return numacnt;
+
+  fd = open("/sys/devices/system/node/possible",O_RDONLY);
+  if (fd == -1) return numacnt = 1;
+  n = read(fd,buf,sizeof(buf) - 1);
+  close(fd);
+  if (n <= 0) return numacnt = 1;
+  buf[n] = 0;
+  for (i = 0; i < (unsigned int)n; i++) { // last number in list is highest node
+    if (buf[i] >= '0' && buf[i] <= '9') cnt = cnt * 10 + (unsigned int)(buf[i] - '0');
+    else if (buf[i] != '\n') cnt = 0;
+  }
+  cnt++;
+  if (cnt > Maxnode) cnt = Maxnode;
+  return numacnt = cnt;
+}
+
+unsigned int osnumanode(void)
+{
+  unsigned int cpu,node;
+
+  if (syscall(SYS_getcpu,&cpu,&node,NULL)) return 0;
+  return node < Maxnode ? node : 0;
+}
+
+// bind to given node, or interleave over all nodes if node is negative
+int osmbind(void *p,size_t len,int node)
+{
+  unsigned long mask;
+  unsigned int cnt;
+  int mode;
+
+  if (node >= 0) {
+    mask = 1ul << (node & (Maxnode - 1));
+    mode = Mpol_bind;
+  } else {
+    cnt = osnumacnt();
+    mask = cnt >= Maxnode ? ~0ul : (1ul << cnt) - 1;
+    mode = Mpol_interleave;
+  }
+  return (int)syscall(SYS_mbind,p,len,mode,&mask,Maxnode + 1,0);
+}
+
+#else
+unsigned int osnumacnt(void) { return 1; }
+unsigned int osnumanode(void) { return 0; }
+int osmbind(void *p,size_t len,int node) { return 0; }
+#endif
+
 #elif defined _WIN32 || defined _WIN64
 
  #include <memoryapi.h>
@@ -2,7 +2,23 @@
 */
 
 extern int oswrite(int fd,const char *buf,size_t len);
+extern int oswritev(int fd,const void **bufs,const size_t *lens,int cnt);
 
 extern void *osmmap(size_t len);
-extern void *osmunmap(void *p,size_t len);
+extern void osmunmap(void *p,size_t len);
 extern void *osmremap(void *p,size_t orglen,size_t newlen);
+extern void *osmremap_fixed(void *p,size_t orglen,size_t newlen);
+extern void *osmremap_move(void *p,size_t orglen,size_t newlen);
+
+extern int oscreate(const char *path);
+extern int oscopyfile(int fd,const char *path);
+
+extern int osmlock(void *p,size_t len);
+extern void osprefault(void *p,size_t len);
+extern int ospurge(void *p,size_t len);
+extern size_t oscachelen(void);
+extern void osyield(void);
+
+extern unsigned int osnumacnt(void);
+extern unsigned int osnumanode(void);
+extern int osmbind(void *p,size_t len,int node);
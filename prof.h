@@ -0,0 +1,173 @@
+/* prof.h - sampling heap profiler
+
+   This file is part of yalloc, yet another memory allocator with emphasis on efficiency and compactness.
+
+   SPDX-FileCopyrightText: © 2024 Joris van der Geer
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+  Every prof_rate bytes on average, exponentially distributed, an allocation is sampled: its backtrace is recorded in a per-heap side table keyed by pointer.
+  free() drops the entry. yal_prof_dump() writes all live samples in pprof legacy heap profile format.
+  The alloc fast path only decrements a per-heap byte counter. Backtraces walk frame pointers, thus build with -fno-omit-frame-pointer
+*/
+
+#define Prof_recheck (1l << 24) // bytes between checks for prof_rate when disabled
+#define Prof_stackgap 0x100000 // max frame size in backtrace walk
+
+static void *yalloc_heap(heap *hb,size_t len,bool clear);
+
+// xorshift
+static ub8 prof_rnd(heap *hb)
+{
+  ub8 x = hb->profrnd;
+
+  if (x == 0) x = ((size_t)hb >> 4) | 1;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return hb->profrnd = x;
+}
+
+// exponentially distributed with mean prof_rate, using a coarse log2
+static sb8 prof_next(heap *hb)
+{
+  ub8 q = (prof_rnd(hb) >> 38) + 1; // 26 bits
+  ub4 lg = 63 - clzl(q);
+  double log2q = lg + (double)(q - (1ul << lg)) / (double)(1ul << lg);
+  double e = (26.0 - log2q) * 0.6931471805599453; // -ln(q / 2^26)
+
+  return (sb8)(e * (double)prof_rate) + 1;
+}
+
+static Noinline ub4 prof_backtrace(void **pcs,ub4 max)
+{
+  void **fp = __builtin_frame_address(0);
+  void **nfp;
+  ub4 n = 0;
+
+  while (fp && n < max) {
+    pcs[n++] = fp[1];
+    nfp = (void **)fp[0];
+    if (nfp <= fp || (size_t)nfp - (size_t)fp > Prof_stackgap || ((size_t)nfp & 7)) break;
+    fp = nfp;
+  }
+  return n;
+}
+
+static ub4 prof_hash(size_t ip)
+{
+  return (ub4)(((ip >> 4) * 0x9e3779b97f4a7c15ul) >> (64 - Prof_tab));
+}
+
+static void prof_add(heap *hb,void *p,size_t len)
+{
+  struct profent *tab = hb->proftab;
+  struct profent *pe;
+  void *pcs[Prof_depth + 1];
+  ub4 i,n;
+
+  if (tab == nil) {
+    tab = osmem(__LINE__,Fprof,hb,sizeof(struct profent) << Prof_tab,"prof table");
+    if (tab == nil) return;
+    hb->proftab = tab;
+  }
+  if (hb->profcnt >= (3u << Prof_tab) / 4) { ystat(hb,profdrop) return; }
+
+  i = prof_hash((size_t)p);
+  while (tab[i].ip) i = (i + 1) & ((1u << Prof_tab) - 1);
+
+  n = prof_backtrace(pcs,Prof_depth + 1);
+  n = n ? n - 1 : 0; // skip own frame. allocator frames are left for pprof to drop
+  pe = tab + i;
+  pe->ip = (size_t)p;
+  pe->len = len;
+  pe->depth = n;
+  memcpy(pe->pcs,pcs + 1,n * sizeof(void *));
+  hb->profcnt++;
+  ystat(hb,profsamples)
+}
+
+// triggered when the byte counter runs out. The counter includes len, as yalloc_heap() subtracts it again
+static void *prof_alloc(heap *hb,size_t len,bool clear)
+{
+  void *p;
+
+  if (prof_rate == 0) {
+    hb->profleft = Prof_recheck + (sb8)len;
+    return yalloc_heap(hb,len,clear);
+  }
+  hb->profleft = prof_next(hb) + (sb8)len;
+  p = yalloc_heap(hb,len,clear);
+  if (p) prof_add(hb,p,len);
+  return p;
+}
+
+// remove entry, backward shift deletion
+static void prof_free(heap *hb,void *p)
+{
+  struct profent *tab = hb->proftab;
+  size_t ip = (size_t)p;
+  ub4 msk = (1u << Prof_tab) - 1;
+  ub4 i,j,h;
+
+  i = prof_hash(ip);
+  while (tab[i].ip != ip) {
+    if (tab[i].ip == 0) return;
+    i = (i + 1) & msk;
+  }
+  hb->profcnt--;
+
+  j = i;
+  for (;;) {
+    tab[i].ip = 0;
+    do {
+      j = (j + 1) & msk;
+      if (tab[j].ip == 0) return;
+      h = prof_hash(tab[j].ip);
+    } while (i <= j ? (i < h && h <= j) : (i < h || h <= j));
+    tab[i] = tab[j];
+    i = j;
+  }
+}
+
+void yal_prof(size_t rate)
+{
+  heap *hb = thread_heap;
+
+  prof_rate = rate;
+  if (hb && ((size_t)hb & 1) == 0) hb->profleft = rate ? prof_next(hb) : Prof_recheck;
+}
+
+// pprof legacy heap profile format, followed by the memory map for symbolization
+int yal_prof_dump(int fd)
+{
+  char buf[4096];
+  ub4 pos,i,d;
+  size_t cnt = 0,bytes = 0;
+  struct profent *pe;
+  heap *hb;
+
+  for (hb = atomic_load_explicit(&heaplist,memory_order_acquire); hb; hb = hb->nxt) {
+    if (hb->proftab == nil) continue;
+    for (i = 0; i < (1u << Prof_tab); i++) {
+      if (hb->proftab[i].ip == 0) continue;
+      cnt++;
+      bytes += hb->proftab[i].len;
+    }
+  }
+  pos = mini_snprintf(buf,0,sizeof(buf),"heap profile: %zu: %zu [%zu: %zu] @ heap_v2/%zu\n",cnt,bytes,cnt,bytes,prof_rate);
+
+  for (hb = atomic_load_explicit(&heaplist,memory_order_acquire); hb; hb = hb->nxt) {
+    if (hb->proftab == nil) continue;
+    for (i = 0; i < (1u << Prof_tab); i++) {
+      pe = hb->proftab + i;
+      if (pe->ip == 0) continue;
+      if (pos + 64 + Prof_depth * 20 > sizeof(buf)) { oswrite(fd,buf,pos); pos = 0; }
+      pos += mini_snprintf(buf,pos,sizeof(buf),"1: %zu [1: %zu] @",pe->len,pe->len);
+      for (d = 0; d < pe->depth && d < Prof_depth; d++) pos += mini_snprintf(buf,pos,sizeof(buf)," %p",pe->pcs[d]);
+      buf[pos++] = '\n';
+    }
+  }
+  pos += mini_snprintf(buf,pos,sizeof(buf),"\nMAPPED_LIBRARIES:\n");
+  oswrite(fd,buf,pos);
+  return oscopyfile(fd,"/proc/self/maps");
+}
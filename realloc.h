@@ -8,16 +8,92 @@
 
 static void *realloc_copy(heap *hb,void *op,size_t olen,size_t nlen,bool dofree)
 {
-  void *np = yalloc_heap(hb,nlen,0);
+  void *np;
 
-  if (np) memcpy(np,op,olen);
+  if (dofree && nlen >= mmap_limit(hb) && olen >= Page) { // large buddy block: remap pages into the mmap tier
+    np = mmap_promote(hb,op,olen,nlen);
+    if (np) {
+      yfree_heap(hb,op,0);
+      return np;
+    }
+  }
+
+  np = yalloc_heap(hb,nlen,0);
+
+  if (np) ycopy(np,op,olen);
   if (dofree && (np || FREE_FAIL_REALLOC) ) yfree_heap(hb,op,0);
   return np;
 }
 
-static void *yrealloc(void *p,size_t newlen)
+// usable length of a block in region reg. Constant time: the region's cel len or order map
+static size_t reglen(region *reg,size_t ip)
+{
+  switch (reg->typ) {
+  case Rslab: return reg->cellen;
+  case Rbuddy: return buddy_len(reg,ip);
+  case Rmmap: return reg->len - (ip - (size_t)reg->user);
+  default: return 0;
+  }
+}
+
+// usable length of a bump block of heap hb, up to the next header. 0 if not in its bump area
+static size_t bumplen(const heap *hb,const void *p)
+{
+  const char *cp = p;
+
+  if (cp >= hb->inimem + 4 && cp < hb->inimem + Inimem) return doalign(((const ub4 *)cp)[-1],Basealign);
+  return 0;
+}
+
+// usable length of a block in heap hb, 0 if not in hb
+static size_t blocklen(heap *hb,const void *p)
+{
+  size_t len = bumplen(hb,p);
+  region *reg;
+
+  if (len) return len;
+  reg = findregion(hb,(size_t)p);
+  return reg ? reglen(reg,(size_t)p) : 0;
+}
+
+// usable length of a live block in any heap, for malloc_usable_size(). Other heaps via the global directory, as remote_free()
+static size_t ysize(const void *p)
 {
   heap *hb = thread_heap;
+  size_t len,ent;
+
+  if (isboot(p)) return bootlen(p);
+  if (hb && ((size_t)hb & 1) == 0 && (len = blocklen(hb,p)) ) return len;
+  ent = gdir_find((size_t)p);
+  if (ent & Gtag_heap) return bumplen((heap *)(ent & ~(size_t)Gtag_msk),p);
+  if (ent & Gtag_reg) return reglen((region *)(ent & ~(size_t)Gtag_msk),(size_t)p);
+  return 0;
+}
+
+// grow in place to at least minlen, preferably maxlen. Blocks never move. Returns the usable length, 0 if below minlen
+static size_t yexpand(void *p,size_t minlen,size_t maxlen)
+{
+  heap *hb = thread_heap;
+  region *reg;
+  size_t ip = (size_t)p;
+  size_t len,xlen;
+
+  if (hb == nil || ((size_t)hb & 1) || isboot(p)) len = ysize(p);
+  else if ( (reg = findregion(hb,ip)) && reg->typ == Rmmap) {
+    len = reg->len - (ip - (size_t)reg->user);
+    if (len < maxlen) {
+      xlen = mmap_expand(hb,reg,ip - (size_t)reg->user,maxlen);
+      if (xlen == 0 && len < minlen) xlen = mmap_expand(hb,reg,ip - (size_t)reg->user,minlen);
+      len = max(len,xlen);
+    }
+  } else len = ysize(p); // bump, cel or buddy slack. Buddy blocks are not merged with a free neighbour
+  ylog(Frealloc,"expand %p to %zu`b .. %zu`b: %zu`b",p,minlen,maxlen,len);
+  return len >= minlen ? len : 0;
+}
+
+static void *yrealloc(void *p,size_t newlen)
+{
+  heap *hb = setupheap();
   region *reg;
   char *cp = p;
   ub4 oldlen,*up;
@@ -29,21 +105,24 @@ static void *yrealloc(void *p,size_t newlen)
   size_t ip = (size_t)p;
   size_t orglen;
 
-  if (hb == nil) {
-    error(__LINE__,Frealloc,"realloc(%p) in nonexistent heap",p);
-    return nil;
-  }
+  if (hb == nil) return nil;
+  ytrace(Frealloc,hb,Trealloc,newlen,p,0)
+
+  if (isboot(p)) return realloc_copy(hb,p,min(bootlen(p),newlen),newlen,0);
 
   if (cp >= hb->inimem + 4 && cp < hb->inimem + Inimem) {  // initial bump alloc
     up = (ub4 *)cp;
     oldlen = up[-1];
     if (oldlen == 0) free2(__LINE__,Frealloc,p,0,"in bootmem");
+    oldlen = doalign(oldlen,Basealign); // usable, see bumplen()
     if (newlen <= oldlen) return p;
     return  realloc_copy(hb,p,oldlen,newlen,0);
   }
 
   reg = findregion(hb,ip);
   if (reg == nil) {
+    orglen = ysize(p);
+    if (orglen) return realloc_copy(hb,p,min(orglen,newlen),newlen,1); // from another thread's heap, freed remotely
     error(__LINE__,Frealloc,"realloc(%p,`%zu) was not malloc()ed",p,newlen);
     return nil;
   }
@@ -59,14 +138,15 @@ static void *yrealloc(void *p,size_t newlen)
     if (newlen <= orglen) return p;
     return realloc_copy(hb,p,orglen,newlen,1);
   } else if (reg->typ == Rbuddy) {
-    return buddy_realloc(hb,reg,p,newlen);
+    if (buddy_realloc(hb,reg,p,newlen)) return p;
+    orglen = buddy_len(reg,ip);
+    return realloc_copy(hb,p,orglen,newlen,1);
   } else if (reg->typ == Rmmap) {
     if ( (size_t)p & (Page - 1)) {
       error(__LINE__,Frealloc,"realloc: invalid ptr %p",p);
       return nil;
     }
     orglen = reg->len;
-    if (newlen <= orglen) return p;
     return mmap_realloc(hb,reg,p,orglen,newlen);
   } else return nil;
 }
@@ -10,10 +10,19 @@
 static void delregmem(heap *hb,region *reg)
 {
   ub4 mapcnt = 1;
-  size_t ulen = (1ul << reg->order);
-  if (reg->user) osunmem(__LINE__,Fregion,hb,reg->user,ulen,"region user");
+  size_t ulen = reg->typ == Rmmap ? reg->len : (1ul << reg->order);
+
+  if (reg->typ == Rmmap && reg->user && mmap_cache_put(hb,reg->user,ulen)) { // keep for reuse
+    reg->user = nil;
+    return;
+  }
+  if (reg->user) {
+    osunmem(__LINE__,Fregion,hb,reg->user,ulen,"region user");
+    ystatdec(hb,mapuser,ulen)
+  }
   if (reg->meta) {
     osunmem(__LINE__,Fregion,hb,reg->meta,reg->metalen,"region meta");
+    ystatdec(hb,mapmeta,reg->metalen)
     mapcnt = 2;
   }
   reg->user = nil;
@@ -51,6 +60,28 @@ static void regdir(heap *hb,region *reg,size_t bas,size_t len)
 #include "dir.h" // generated by genadm from config.h
 }
 
+// move reg from [obas,obas+olen) to [nbas,nbas+nlen): enter the new range first, then clear what is no longer covered
+static void regdir_move(heap *hb,region *reg,size_t obas,size_t olen,size_t nbas,size_t nlen)
+{
+  size_t oend = obas + olen,nend = nbas + nlen;
+  size_t gran = 1ul << Minregion;
+  size_t bas,end;
+
+  regdir(hb,reg,nbas,nlen);
+  gdir_set(nbas,nlen,(size_t)reg | Gtag_reg);
+  if (obas < nbas) gdir_set(obas,min(oend,nbas) - obas,0); // page granular
+  if (oend > nend) gdir_set(max(obas,nend),oend - max(obas,nend),0);
+
+  if (obas < nbas) { // head
+    end = min(oend,nbas & ~(gran - 1));
+    if (end > obas) regdir(hb,nil,obas,end - obas);
+  }
+  if (oend > nend) { // tail
+    bas = max(obas,doalign(nend,gran));
+    if (oend > bas) regdir(hb,nil,bas,oend - bas);
+  }
+}
+
 static bool delregion(heap *hb,region *reg)
 {
   region *xreg;
@@ -61,6 +92,8 @@ static bool delregion(heap *hb,region *reg)
   size_t ip,len;
 
   ylog(Fregion,"heap %u delete reg %u",hb->id,reg->id);
+  ystat(hb,delregs)
+  ytrace(Fregion,hb,Tdelreg,reg->len,reg->user,reg->id)
 
   ip = (size_t)reg->user;
   if (reg->typ == Rmmap) {
@@ -68,6 +101,7 @@ static bool delregion(heap *hb,region *reg)
     len = reg->len;
   } else len = (1ul << reg->order);
   regdir(hb,nil,ip,len);
+  gdir_set(ip,len,0);
 
   reg->typ = Rnil;
   xreg = hb->freereg;
@@ -76,11 +110,11 @@ static bool delregion(heap *hb,region *reg)
   }
   hb->freereg = reg;
 
-  for (i = 0; i < Regfree_trim && reg; i++) {
+  for (i = 0; i < regfree_trim && reg; i++) {
     if (last) delregmem(hb,reg);
     reg = reg->bin;
   }
-  if (reg && i == Regfree_trim) delregmem(hb,reg);
+  if (reg && i == regfree_trim) delregmem(hb,reg);
   hb->freeregcnt = frecnt + 1;
   return last;
 }
@@ -112,35 +146,73 @@ static region *newregmem(heap *hb)
     if (hb->nxtregs) hb->regmem->nxt = reg; // link
     else hb->nxtregs = reg;
     hb->regmem = reg;
+    hb->regmem_top = Regmem_inc;
     pos = 1;  // leave first entry for link
   } else reg = hb->regmem;
-  hb->regmem_top = pos + 1;
+  hb->regmem_pos = pos + 1;
   return reg + pos;
 }
 
+// bind fresh region memory to the heap's node before first touch
+static void bindregmem(heap *hb,void *p,size_t len)
+{
+#if Yal_enable_numa
+  if (numa_mode == 0) return;
+  if (osmbind(p,len,(int)hb->numanode)) ylog(Fregion,"heap %u mbind %p %zu`b to node %u failed",hb->id,p,len,hb->numanode);
+#endif
+}
+
+// take over memory retained from a recycled region if of same size and numa node, else release it
+static bool reuseregmem(heap *hb,region *reg,size_t len,size_t admlen)
+{
+  if (reg->user == nil) return 0;
+  if ( (1ul << reg->order) == len && reg->metalen >= admlen && reg->node == hb->numanode) {
+    if (reg->meta) memset(reg->meta,0,reg->metalen);
+    ylog(Fregion,"heap %u reuse reg %u mem %zu`b node %u",hb->id,reg->id,len,reg->node);
+    return 1;
+  }
+  delregmem(hb,reg);
+  return 0;
+}
+
 static region *newregion(heap *hb,void*user,size_t len,size_t admlen,enum Rtype typ)
 {
   region *reg;
   size_t adr;
   void *meta;
-  ub4 mapcnt = 1;
-
-  if (user == nil) user = osmem(__LINE__,Fregion,hb,len,"mmap region");
-  if (user == nil) return nil;
-  adr = (size_t)user;
+  ub4 mapcnt = 0;
 
   reg = hb->freereg;
   if (reg ) { // reuse
     if (reg->typ == Rnil) {
       hb->freereg = reg->bin;
     } else hb->freereg = nil;
+    if (reuseregmem(hb,reg,user || typ == Rmmap ? 0 : len,admlen)) {
+      user = reg->user;
+      admlen = 0;
+    }
   } else {
     reg = newregmem(hb);
     if (reg == nil) return nil;
   }
+
+  if (user == nil) {
+    user = osmem(__LINE__,Fregion,hb,len,"mmap region");
+    if (user == nil) return nil;
+    bindregmem(hb,user,len);
+    ystatn(hb,mapuser,len)
+    mapcnt++;
+    reg->zerofrom = 0;
+  } else reg->zerofrom = hi32; // retained or given memory
+  adr = (size_t)user;
+
   reg->typ = typ;
   reg->user = user;
+  reg->node = (ub2)hb->numanode;
+  if (typ != Rmmap) reg->order = (ub1)ctzl(len);
   reg->id = hb->allocregcnt++;
+  ystat(hb,newregs)
+  ytrace(Fregion,hb,Tnewreg,len,user,reg->id)
 
   ylog(Fregion,"heap %u new reg %u bas %zx len %zu`b meta %zu`b",hb->id,reg->id,adr,len,admlen);
 
@@ -150,13 +222,45 @@ static region *newregion(heap *hb,void*user,size_t len,size_t admlen,enum Rtype
     case Rmmap: break;
     case Rslab:
     case Rbuddy:
+      if (admlen == 0) break; // reused
       meta = osmem(__LINE__,Fregion,hb,admlen,"region meta");
       if (meta == nil) return nil;
+      bindregmem(hb,meta,admlen);
+      ystatn(hb,mapmeta,admlen)
       reg->meta = meta;
       reg->metalen = admlen;
       mapcnt++;
   }
   regdir(hb,reg,adr,len);
+  atomic_store_explicit(&reg->owner,hb,memory_order_relaxed);
+  if (gdir_set(adr,len,(size_t)reg | Gtag_reg)) {
+    error(__LINE__,Fregion,"heap %u cannot enter reg %u len %zu`b in global directory",hb->id,reg->id,len);
+    return nil;
+  }
   atomic_fetch_add_explicit(&global_mapcnt,mapcnt,memory_order_relaxed);
   return reg;
 }
+
+// zero a block, by discarding its pages if large. Not while critical, as the pages would fault back in
+static void zeroblk(heap *hb,void *p,size_t len)
+{
+  if (len >= Zero_purge_len && ((size_t)p & (Page - 1)) == 0 && hb->critical == 0) {
+    ystat(hb,oscalls)
+    if (ospurge(p,doalign(len,Page)) == 0) return;
+  }
+  yzero(p,len);
+}
+
+// track a block handed out from reg, and zero it for calloc unless never handed out before
+static void regclear(heap *hb,region *reg,void *p,size_t len,bool clear)
+{
+  size_t ofs = (size_t)p - (size_t)reg->user;
+  size_t zfrom = reg->zerofrom;
+
+  if (ofs >= zfrom && zfrom != hi32) {
+    reg->zerofrom = (ub4)(ofs + len);
+    return;
+  }
+  if (ofs + len > zfrom && zfrom != hi32) reg->zerofrom = (ub4)(ofs + len);
+  if (clear) zeroblk(hb,p,len);
+}
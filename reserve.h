@@ -0,0 +1,86 @@
+/* reserve.h - latency-critical reserve and mode
+
+   This file is part of yalloc, yet another memory allocator with emphasis on efficiency and compactness.
+
+   SPDX-FileCopyrightText: © 2024 Joris van der Geer
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+  yal_reserve() creates slab and buddy regions ahead of use, faults their pages in and optionally locks them.
+  In critical mode, a heap does not call the os for memory: osmem() fails and osunmem() is deferred until release.
+  Each such attempt is counted.
+*/
+
+static int reserve_reg(heap *hb,region *reg,bool lock)
+{
+  size_t len = reg->typ == Rmmap ? reg->len : (1ul << reg->order);
+
+  ylog(Freserve,"heap %u reserve reg %u %zu`b meta %zu`b%s",hb->id,reg->id,len,reg->metalen,lock ? " locked" : "");
+
+  osprefault(reg->user,len);
+  if (reg->meta) osprefault(reg->meta,reg->metalen);
+  if (lock == 0) return 0;
+  if (osmlock(reg->user,len)) return -1;
+  if (reg->meta && osmlock(reg->meta,reg->metalen)) return -1;
+  return 0;
+}
+
+int yal_reserve(size_t bytes,unsigned int classes)
+{
+  heap *hb = getheap();
+  region *reg;
+  void *p;
+  ub4 bit,inipos,ord;
+  bool lock = (classes & Yal_reserve_mlock) != 0;
+  int rv = 0;
+
+  if (hb == nil || hb->critical) return -1;
+
+  osprefault(hb,hb->baselen);
+  if (lock && osmlock(hb,hb->baselen)) rv = -1;
+
+  // one slab per class, bypassing the initial bump allocator
+  inipos = hb->inipos;
+  hb->inipos = Inimem;
+  for (bit = 3; bit < 12; bit++) {
+    if ( (classes & (1u << bit)) == 0) continue;
+    p = yalloc_heap(hb,1u << bit,0);
+    if (p == nil) { rv = -1; continue; }
+    reg = findregion(hb,(size_t)p);
+    yfree_heap(hb,p,0);
+    if (reg && reserve_reg(hb,reg,lock)) rv = -1;
+  }
+  hb->inipos = inipos;
+
+  if (bytes == 0) return rv;
+
+  if (bytes > (1ul << (Maxorder - 1))) bytes = 1ul << (Maxorder - 1);
+  ord = (ub4)(sizeof(size_t) * 8) - clzl(bytes);
+  if ( (bytes & (bytes - 1)) == 0) ord--;
+  ord = max(ord,Minorder);
+
+  reg = buddy_newreg(hb,ord);
+  if (reg == nil) return -1;
+  if (reserve_reg(hb,reg,lock)) rv = -1;
+  return rv;
+}
+
+size_t yal_critical(int on)
+{
+  heap *hb = getheap();
+  struct critdefer *dp;
+  ub4 i;
+
+  if (hb == nil) return 0;
+
+  if (on) hb->critical = 1;
+  else if (hb->critical) {
+    hb->critical = 0;
+    for (i = 0; i < hb->critdefcnt; i++) {
+      dp = hb->critdefer + i;
+      osunmem(__LINE__,Freserve,hb,dp->p,dp->len,"deferred");
+    }
+    hb->critdefcnt = 0;
+  }
+  ylog(Freserve,"heap %u critical %d fails %zu",hb->id,on,hb->critfails);
+  return hb->critfails;
+}
@@ -25,6 +25,7 @@ static region *newslab(heap *hb,ub4 cellen,ub4 userlen)
   ub4 ord;
 
   ylog(Fslab,"new slab cel len %u,%u ord %u",cellen,userlen,order);
+  ylat(hb,Yal_lat_newslab)
 
   if (cellen & (cellen - 1)) {
     cnt = (ub4)(reglen / cellen);
@@ -85,7 +86,7 @@ static void *slab_alloc(heap *hb,region *reg,bool clear)
   ub8 *line = meta;
 
   mask = reg->linmask;
-  len = (ub4)reg->len;
+  len = reg->cellen; // cel stride
 
   if (mask != Full) { // fast path: next cel from previous alloc
     ofs = reg->linofs;
@@ -95,7 +96,10 @@ static void *slab_alloc(heap *hb,region *reg,bool clear)
       cel = (ofs << 6) + bit;
       line[ofs] = reg->linmask = mask;
       p = user + cel * len;
-      if (clear) memset(p,0,len);
+      regclear(hb,reg,p,len,clear);
+      ystat(hb,slabfast)
+      ylat(hb,Yal_lat_slabfast)
+      ytrace(Fslab,hb,Tslabfast,len,p,reg->id)
       ylog(Fslab,"slab alloc fast cel %zu = %p",cel,p);
       return p;
     }
@@ -115,8 +119,6 @@ static void *slab_alloc(heap *hb,region *reg,bool clear)
 
   unsigned int cbit = 0,bbit,abit;
 
-  ub8 *line2 = meta + linlen * 2;
-
   ub8 *accA = line + linlen;
   ub8 *accB = accA + accAlen;
   ub8 *accC = accB + accBlen;
@@ -125,6 +127,8 @@ static void *slab_alloc(heap *hb,region *reg,bool clear)
   region *xreg;
 
   ylog(Fslab,"slab alloc reg %u len %u",reg->id,len);
+  ystat(hb,slabslow)
+  ylat(hb,Yal_lat_slabsearch)
 
   // search in freemap
   for (cacc = 0; cacc < accClen; cacc++) {
@@ -160,9 +164,10 @@ static void *slab_alloc(heap *hb,region *reg,bool clear)
 
   p = user + cel * len;
 
-  if (clear && (line2[ofs] & lmask) ) memset(p,0,len);
+  regclear(hb,reg,p,len,clear);
 
   reg->ofs = ofs;
+  ytrace(Fslab,hb,Tslab,len,p,reg->id)
 
   if (--reg->frecnt == 0) { // full, put next in front
     clas = reg->clas;
@@ -189,11 +194,11 @@ static bool slab_chk4free(heap *hb,region *reg,size_t ip)
   ub2 ord;
 
   ofs8 = (ub4)(ip - ibase);
-  if (ofs8  >= reg->cnt) { error(__LINE__,Fslab,"heap %u invalid free of ptr %lx of size %lu",hb->id,ip,reg->len); return 1; }
+  if (ofs8  >= reg->cnt * reg->cellen) { error(__LINE__,Fslab,"heap %u invalid free of ptr %lx of size %lu",hb->id,ip,reg->len); return 1; }
 
   ord = reg->celord;
   if (ord) cel = ofs8 >> ord;
-  else cel = ofs8 / (ub4)reg->len;
+  else cel = ofs8 / reg->cellen;
 
   ofs = cel >> 6;
   bit = cel - (ofs << 6);
@@ -214,7 +219,7 @@ static bool slab_free(heap *hb,region *reg,size_t ip)
   size_t ibase = (size_t)reg->user;
   ub4 ofs8;
   ub8 msk;
-  ub8 len = reg->len;
+  ub8 len = reg->cellen;
   ub2 order = reg->order;
   ub2 ord = reg->minorder;
   ub4 reglen = (1u << order);
@@ -0,0 +1,178 @@
+/* stats.h - statistics
+
+   This file is part of yalloc, yet another memory allocator with emphasis on efficiency and compactness.
+
+   SPDX-FileCopyrightText: © 2024 Joris van der Geer
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+  Each heap counts in its own stat struct, written only by its owning thread. No atomics on the fast path.
+  Aggregation reads all heaps via the heap list without stopping their threads, thus may be slightly out of date.
+  Heap bases are never unmapped, so this is safe for deleted heaps too. Their counts remain included.
+*/
+
+#define Statcnt (sizeof(struct yal_stats) / sizeof(size_t))
+
+static void addstats(struct yal_stats *sp,const heap *hb)
+{
+  const volatile size_t *src = (const volatile size_t *)&hb->stat;
+  size_t *dst = (size_t *)sp;
+  size_t thresh = sp->mmap_threshold;
+  ub4 i;
+
+  sassert(sizeof(struct yal_stats) == Statcnt * sizeof(size_t),"yal_stats has size_t members only");
+
+  for (i = 0; i < Statcnt; i++) dst[i] += src[i];
+  sp->mmcachelen += hb->mmcachelen;
+  sp->critfails += hb->critfails;
+  sp->mmap_threshold = max(thresh,mmap_limit(hb));
+  if (atomic_load_explicit(&hb->inuse,memory_order_relaxed) == Heap_inuse) sp->heaps++;
+}
+
+void yal_stats(struct yal_stats *sp,int all)
+{
+  heap *hb;
+
+  memset(sp,0,sizeof(struct yal_stats));
+
+  if (all == 0) {
+    hb = thread_heap;
+    if (hb && ((size_t)hb & 1) == 0) addstats(sp,hb);
+    return;
+  }
+
+  for (hb = atomic_load_explicit(&heaplist,memory_order_acquire); hb; hb = hb->nxt) addstats(sp,hb);
+}
+
+int yal_latency(struct yal_latency *lp,int all)
+{
+  memset(lp,0,sizeof(struct yal_latency));
+
+#if Yal_enable_latency
+  const volatile size_t *src;
+  heap *hb;
+  ub4 path,b;
+
+  hb = all ? atomic_load_explicit(&heaplist,memory_order_acquire) : thread_heap;
+  if (hb == nil || ((size_t)hb & 1)) return 0;
+
+  do {
+    for (path = 0; path < Yal_lat_count; path++) {
+      src = hb->lathist[path];
+      for (b = 0; b < Yal_lat_buckets; b++) lp->hist[path][b] += src[b];
+    }
+  } while (all && (hb = hb->nxt) );
+  return 0;
+#else
+  return -1;
+#endif
+}
+
+// size and bin-held count for slab class of tentative class tclas. returns 0 if not a class
+static bool clasinfo(const heap *hb,ub4 tclas,ub4 *plen,ub4 *pbin)
+{
+  ub4 calen = hb->tclas2len[tclas];
+  ub2 clas = hb->tclas2clas[tclas];
+  ub4 binmask;
+
+  if (clas == hi16) return 0;
+  *plen = calen <= 16 ? calen : (calen - 16) << 4; // see yalloc_heap()
+  binmask = hb->binmasks[clas];
+  *pbin = (ub4)__builtin_popcount(binmask);
+  return 1;
+}
+
+#define Infobuf 4096
+
+static void infoflush(FILE *fp,char *buf,ub4 *pos,ub4 room)
+{
+  if (*pos + room < Infobuf) return;
+  fwrite(buf,1,*pos,fp);
+  *pos = 0;
+}
+
+// malloc_info() body, glibc-style xml per heap and per size class
+static int heapinfo(FILE *fp)
+{
+  char buf[Infobuf];
+  ub4 pos,t,tcnt,len,bin;
+  struct yal_stats st,tot;
+  heap *hb;
+
+  memset(&tot,0,sizeof(tot));
+  pos = mini_snprintf(buf,0,Infobuf,"<malloc version=\"1\">\n");
+
+  for (hb = atomic_load_explicit(&heaplist,memory_order_acquire); hb; hb = hb->nxt) {
+    memset(&st,0,sizeof(st));
+    addstats(&st,hb);
+    addstats(&tot,hb);
+    pos += mini_snprintf(buf,pos,Infobuf,"<heap nr=\"%u\" inuse=\"%u\">\n<sizes>\n",hb->id,(ub4)st.heaps);
+    tcnt = min(hb->tclascnt,Maxtclass);
+    for (t = 0; t < tcnt; t++) {
+      if (clasinfo(hb,t,&len,&bin) == 0) continue;
+      infoflush(fp,buf,&pos,128);
+      pos += mini_snprintf(buf,pos,Infobuf,"  <size from=\"%u\" to=\"%u\" total=\"%u\" count=\"%u\"/>\n",len,len,len * bin,bin);
+    }
+    infoflush(fp,buf,&pos,1024);
+    pos += mini_snprintf(buf,pos,Infobuf,"</sizes>\n");
+    pos += mini_snprintf(buf,pos,Infobuf,"<total type=\"mmap\" count=\"%zu\" size=\"%zu\"/>\n",st.mmap - st.freemmap,st.mmaplen);
+    pos += mini_snprintf(buf,pos,Infobuf,"<total type=\"mmapcache\" hit=\"%zu\" miss=\"%zu\" threshold=\"%zu\"/>\n",st.mmcachehit,st.mmcachemiss,st.mmap_threshold);
+    pos += mini_snprintf(buf,pos,Infobuf,"<total type=\"regions\" created=\"%zu\" deleted=\"%zu\"/>\n",st.newregs,st.delregs);
+    pos += mini_snprintf(buf,pos,Infobuf,"<system type=\"current\" size=\"%zu\"/>\n",st.mapuser);
+    pos += mini_snprintf(buf,pos,Infobuf,"<aspace type=\"meta\" size=\"%zu\"/>\n</heap>\n",st.mapmeta);
+  }
+  infoflush(fp,buf,&pos,512);
+  pos += mini_snprintf(buf,pos,Infobuf,"<total type=\"mmap\" count=\"%zu\" size=\"%zu\"/>\n",tot.mmap - tot.freemmap,tot.mmaplen);
+  pos += mini_snprintf(buf,pos,Infobuf,"<system type=\"current\" size=\"%zu\"/>\n",tot.mapuser);
+  pos += mini_snprintf(buf,pos,Infobuf,"<aspace type=\"meta\" size=\"%zu\"/>\n</malloc>\n",tot.mapmeta);
+  fwrite(buf,1,pos,fp);
+  return 0;
+}
+
+// malloc_stats() body, text to stderr
+static void heapstats(void)
+{
+  char buf[Infobuf];
+  ub4 pos = 0;
+  struct yal_stats st,tot;
+  heap *hb;
+
+  memset(&tot,0,sizeof(tot));
+
+  for (hb = atomic_load_explicit(&heaplist,memory_order_acquire); hb; hb = hb->nxt) {
+    memset(&st,0,sizeof(st));
+    addstats(&st,hb);
+    addstats(&tot,hb);
+    if (pos + 512 > Infobuf) { oswrite(2,buf,pos); pos = 0; }
+    pos += mini_snprintf(buf,pos,Infobuf,"heap %u%s\n  system bytes   = %zu`b\n  meta bytes     = %zu`b\n  mmap bytes     = %zu`b in %zu blocks\n",
+      hb->id,st.heaps ? "" : " (deleted)",st.mapuser,st.mapmeta,st.mmaplen,st.mmap - st.freemmap);
+    pos += mini_snprintf(buf,pos,Infobuf,"  allocs         = bump %zu` bin %zu` slab %zu`/%zu` buddy %zu` mmap %zu`\n",
+      st.bump,st.binhit,st.slabfast,st.slabslow,st.buddy,st.mmap);
+    pos += mini_snprintf(buf,pos,Infobuf,"  frees          = bump %zu` slab %zu` buddy %zu` mmap %zu` remote %zu` evict %zu`\n",
+      st.freebump,st.freeslab,st.freebuddy,st.freemmap,st.freeremote,st.binevict);
+  }
+  pos += mini_snprintf(buf,pos,Infobuf,"total %zu heaps\n  system bytes   = %zu`b\n  meta bytes     = %zu`b\n  mmap bytes     = %zu`b\n  regions        = %zu` created %zu` deleted\n  os calls       = %zu`\n",
+    tot.heaps,tot.mapuser,tot.mapmeta,tot.mmaplen,tot.newregs,tot.delregs,tot.oscalls);
+
+#if Yal_enable_latency
+  static cchar *latnames[Yal_lat_count] = { "bump","bin","slab fast","slab search","buddy","new slab","mmap","free","remote free" };
+  struct yal_latency lat;
+  size_t n,cnt,sum;
+  ub4 path,b,p50,p99;
+
+  yal_latency(&lat,1);
+  for (path = 0; path < Yal_lat_count; path++) {
+    for (cnt = 0,b = 0; b < Yal_lat_buckets; b++) cnt += lat.hist[path][b];
+    if (cnt == 0) continue;
+    p50 = p99 = 0;
+    for (sum = 0,b = 0; b < Yal_lat_buckets; b++) {
+      n = lat.hist[path][b];
+      if (sum < cnt / 2 && sum + n >= cnt / 2) p50 = b;
+      sum += n;
+      if (sum * 100 >= cnt * 99) { p99 = b; break; }
+    }
+    if (pos + 128 > Infobuf) { oswrite(2,buf,pos); pos = 0; }
+    pos += mini_snprintf(buf,pos,Infobuf,"  latency %-11s %zu` calls, p50 < %zu` p99 < %zu` ticks\n",latnames[path],cnt,2ul << p50,2ul << p99);
+  }
+#endif
+  oswrite(2,buf,pos);
+}
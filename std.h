@@ -4,8 +4,29 @@
 
    SPDX-FileCopyrightText: © 2024 Joris van der Geer
    SPDX-License-Identifier: GPL-3.0-or-later
+
+  The complete glibc malloc interface, including the __libc_ aliases, so libyalloc.so can be preloaded into existing binaries.
+  Calls made while a thread's heap is set up are served from static boot memory. Built as shared library with initial-exec TLS,
+  thread_heap is in the static TLS block, thus accessible before any allocation.
 */
 
+#include <errno.h>
+
+#ifdef Yal_prefix
+ #define malloc yal_malloc
+ #define free yal_free
+ #define free_sized yal_free_sized
+ #define calloc yal_calloc
+ #define realloc yal_realloc
+ #define aligned_alloc yal_aligned_alloc
+ #define memalign yal_memalign
+ #define valloc yal_valloc
+ #define pvalloc yal_pvalloc
+ #define posix_memalign yal_posix_memalign
+ #define reallocarray yal_reallocarray
+ #define malloc_usable_size yal_malloc_usable_size
+#endif
+
 static size_t zeroblock;
 
 void *malloc(size_t n)
@@ -22,7 +43,8 @@ void *malloc(size_t n)
       vg_mem_undef(p,n)
     }
 #endif
-  } else {
+    ytraceapi(Tmalloc,n,p,0)
+  } else { // not traced, as its free() is not
     p = &zeroblock;
     ylog(Fstd,"alloc 0 = %p",p);
     vg_mem_noaccess(p,sizeof(zeroblock))
@@ -37,12 +59,19 @@ void free(void *p)
     if (zeroblock != 0) error(__LINE__,Fstd,"written to malloc(0) block (%zx)",zeroblock);
     return;
   }
+  ytraceapi(Tfreecall,0,p,0)
   yfree(p,0);
 }
 
-void free_sized(void *p,Unused size_t n)
+void free_sized(void *p,size_t n)
 {
-  free(p);
+  if (p == nil) return;
+  if (p == &zeroblock) {
+    free(p);
+    return;
+  }
+  ytraceapi(Tfreecall,0,p,0)
+  yfree(p,n);
 }
 
 void *calloc (size_t count, size_t size)
@@ -55,7 +84,7 @@ void *calloc (size_t count, size_t size)
 #if SIZE_MAX == hi32
   unsigned long long nn = (unsigned long long)count * size;
   if (nn >= hi32) return oom(__LINE__,Fstd,count,size);
-  n = (size_t)n;
+  n = (size_t)nn;
 #else
   if (sat_mul(count,size,&n))  return oom(__LINE__,Fstd,count,size);
   if (n > (Maxvmsiz >> 2) ) return oom(__LINE__,Fstd,count,size);
@@ -65,11 +94,14 @@ void *calloc (size_t count, size_t size)
   if (p) {
     vg_mem_def(p,n)
   }
+  ytraceapi(Tcalloc,n,p,0)
   return p;
 }
 
 void *realloc(void *p,size_t newlen)
 {
+  void *np;
+
   if (p == nil) return malloc(newlen);
 
   if (newlen == 0) {
@@ -78,43 +110,165 @@ void *realloc(void *p,size_t newlen)
   }
   if (newlen > (Maxvmsiz >> 2) ) return oom(__LINE__,Fstd,newlen,1);
 
-  return yrealloc(p,newlen);
+  ytraceapi(Trealfrom,newlen,p,0)
+  np = yrealloc(p,newlen);
+  ytraceapi(Trealto,newlen,np,0)
+  return np;
 }
 
 void *aligned_alloc(size_t align, size_t size)
 {
-  ub4 ord;
+  void *p;
 
   if (size > (Maxvmsiz >> 1) || align > (Maxvmsiz >> 2) ) return oom(__LINE__,Fstd,size,1);
   else if (size == 0) return malloc(0);
-  return yalloc_align(align,size);
+  p = yalloc_align(align,size);
+  ytraceapi(Taligned,size,p,(ub4)min(align,hi32))
+  return p;
 }
 
-#ifdef _Yal_enable_psx_memalign
-#include <errno.h>
-int posix_memalign(void **memptr, size_t align, size_t size)
+void *memalign(size_t align,size_t size)
+{
+  return aligned_alloc(align,size);
+}
+
+void *valloc(size_t size)
+{
+  return aligned_alloc(Page,size);
+}
+
+void *pvalloc(size_t size)
+{
+  return aligned_alloc(Page,size ? doalign(size,Page) : Page); // a page, not the malloc(0) block
+}
+
+int posix_memalign(void **memptr,size_t align,size_t size)
 {
   void *p;
 
-  // if (align < sizeof(void *)) return EINVAL;
+  if (align < sizeof(void *) || (align & (align - 1))) return EINVAL;
   p = aligned_alloc(align,size);
-  *memptr = p;
-
   if (p == nil) return ENOMEM;
+  *memptr = p;
   return 0;
 }
-#endif
 
-#ifdef _Yal_enable_c23
+void *reallocarray(void *p,size_t count,size_t size)
+{
+  size_t n;
+
+  if (sat_mul(count,size,&n)) {
+    errno = ENOMEM;
+    return nil;
+  }
+  return realloc(p,n);
+}
+
+size_t malloc_usable_size(void *p)
+{
+  if (p == nil || p == &zeroblock) return 0;
+  return ysize(p);
+}
+
+// size-returning malloc as in C++ P0901: *usable receives the length available to the caller, at least n
+void *yal_malloc_sized(size_t n,size_t *usable)
+{
+  void *p;
+
+  if (unlikely(n > (Maxvmsiz >> 2))) p = oom(__LINE__,Fstd,n,1);
+  else p = yalloc(n ? n : 1,0);
+  ytraceapi(Tmalloc,n,p,0)
+  if (usable) *usable = p ? ysize(p) : 0;
+  return p;
+}
+
+// copy and zero fill as used for realloc() and calloc(), non-temporal for large blocks
+void yal_copy(void *dst,const void *src,size_t len)
+{
+  if (unlikely(atomic_load_explicit(&conf_done,memory_order_acquire) != Conf_done)) yal_conf();
+  ycopy(dst,src,len);
+}
+
+void yal_zero(void *p,size_t len)
+{
+  if (unlikely(atomic_load_explicit(&conf_done,memory_order_acquire) != Conf_done)) yal_conf();
+  yzero(p,len);
+}
+
+size_t yal_expand(void *p,size_t minlen,size_t maxlen)
+{
+  if (p == nil || p == &zeroblock) return 0;
+  return yexpand(p,minlen,max(minlen,maxlen));
+}
+
+// C++ operator new and delete, see new.cpp. The heap lookup is inlined, and there is no shared zero-length block
+// Blocks from 16 bytes on are 16-aligned, thus smaller ones are rounded up to meet __STDCPP_DEFAULT_NEW_ALIGNMENT__
+void *yal_new(size_t len)
+{
+  heap *hb = thread_heap;
+  void *p;
+
+  if (unlikely(len > (Maxvmsiz >> 2))) return nil;
+  if (unlikely(hb == nil || ((size_t)hb & 1))) {
+    if (heap_setup) return bootalloc(len);
+    hb = setupheap();
+    if (hb == nil) return nil;
+  }
+  p = yalloc_heap(hb,len < 16 ? 16 : len,0);
+  ytraceapi(Tmalloc,len,p,0)
+  return p;
+}
+
+// calen is the size class index for len as computed in yalloc_heap(), here resolved at compile time. See yalloc.hpp
+void *yal_new_class(size_t len,unsigned int calen)
+{
+  heap *hb = thread_heap;
+  void *p;
+
+  sassert(Yal_class_len == Maxclasslen,"Yal_class_len matches Maxclasslen");
+  sassert(Yal_sizeclass(Yal_class_len - 1) < Calencnt,"Calencnt covers all class indices");
+
+  if (unlikely(hb == nil || ((size_t)hb & 1) || guardbit)) return yal_new(len);
 
-void free_sized(void *ptr, Unused size_t size)
+  if (unlikely(yalloc_pre(hb,len))) return prof_alloc(hb,len,0);
+
+  p = yalloc_fixed(hb,len,calen);
+  ytraceapi(Tmalloc,len,p,0)
+  return p;
+}
+
+void *yal_new_aligned(size_t align,size_t len)
 {
-  free(ptr,size);
+  void *p;
+
+  if (unlikely(len > (Maxvmsiz >> 2) || align > (Maxvmsiz >> 2))) return nil;
+  p = yalloc_align(align,len ? len : 1);
+  ytraceapi(Taligned,len,p,(ub4)min(align,hi32))
+  return p;
 }
 
-void free_aligned_sized(void *ptr, size_t alignment, size_t size)
+// len is 0 if unknown
+void yal_delete(void *p,size_t len)
 {
-  free(ptr,size);
+  if (p == nil) return;
+  ytraceapi(Tfreecall,0,p,0)
+  yfree(p,len);
 }
 
+// glibc internal names, used by e.g. libpthread and interposers
+#if defined __linux__ && !defined Yal_prefix && (Isgcc || Isclang)
+ #if Isgcc && __GNUC__ >= 9
+  #define Aliasof(f) __attribute__ ((alias(#f),copy(f))) // also malloc, alloc_size etc. as declared by glibc
+ #else
+  #define Aliasof(f) __attribute__ ((alias(#f)))
+ #endif
+void *__libc_malloc(size_t n) Aliasof(malloc);
+void __libc_free(void *p) Aliasof(free);
+void *__libc_calloc(size_t count,size_t size) Aliasof(calloc);
+void *__libc_realloc(void *p,size_t newlen) Aliasof(realloc);
+void *__libc_memalign(size_t align,size_t size) Aliasof(memalign);
+void *__libc_valloc(size_t size) Aliasof(valloc);
+void *__libc_pvalloc(size_t size) Aliasof(pvalloc);
+int __posix_memalign(void **memptr,size_t align,size_t size) Aliasof(posix_memalign);
 #endif
+
@@ -0,0 +1,136 @@
+/* test.c - checks for blocks crossing threads: remote free, usable size from another thread, and heaps of exited threads
+
+   This file is part of yalloc, yet another memory allocator with emphasis on efficiency and compactness.
+
+   SPDX-FileCopyrightText: © 2024 Joris van der Geer
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   usage: test [rounds]
+   Linked with yalloc.c itself, thus malloc() and free() are yalloc's. Exits nonzero if any check fails.
+
+   remote - a thread allocates small blocks and an mmap block, a second thread checks their usable size and frees them
+            while the owner is still running. The owner is found via the global directory, see globdir.h
+   exit   - threads allocate and exit before their blocks are freed. The blocks are freed into the orphaned heap,
+            and a later thread adopts it. No mmap bytes or heaps in use are to be left behind
+*/
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+
+#include "yalloc.h"
+
+#define Blocks 64
+#define Big (1ul << 26) // above the adaptive mmap threshold
+
+struct blocks {
+  char *p[Blocks + 1];
+  size_t len[Blocks + 1];
+};
+
+static int fails;
+
+static void fail(const char *test,const char *msg,size_t a,size_t b)
+{
+  fprintf(stderr,"%s: %s %zu %zu\n",test,msg,a,b);
+  fails++;
+}
+
+static void alloc_blocks(struct blocks *bp,unsigned int seed)
+{
+  unsigned int i;
+  size_t len;
+
+  for (i = 0; i <= Blocks; i++) {
+    len = i < Blocks ? 8 + (seed * 7 + i * 13) % 120 : Big;
+    bp->p[i] = malloc(len);
+    bp->len[i] = len;
+    if (bp->p[i]) memset(bp->p[i],(int)i,len < 4096 ? len : 4096);
+  }
+}
+
+// check contents and usable size, then free
+static void free_blocks(const char *test,struct blocks *bp)
+{
+  unsigned int i;
+  size_t ulen;
+
+  for (i = 0; i <= Blocks; i++) {
+    if (bp->p[i] == NULL) { fail(test,"no block for len",bp->len[i],i); continue; }
+    if (bp->p[i][0] != (char)i) fail(test,"block overwritten",i,bp->len[i]);
+    ulen = malloc_usable_size(bp->p[i]);
+    if (ulen < bp->len[i]) fail(test,"usable size below len",ulen,bp->len[i]);
+    free(bp->p[i]);
+  }
+}
+
+static void *remote_free(void *arg)
+{
+  free_blocks("remote",arg);
+  return NULL;
+}
+
+static void *remote_owner(void *arg)
+{
+  struct blocks *bp = arg;
+  pthread_t tid;
+
+  alloc_blocks(bp,1);
+  if (pthread_create(&tid,NULL,remote_free,bp)) { fail("remote","cannot create thread",0,0); return NULL; }
+  pthread_join(tid,NULL);
+
+  alloc_blocks(bp,2); // drains the frees above
+  free_blocks("remote",bp);
+  return NULL;
+}
+
+static void *exit_child(void *arg)
+{
+  alloc_blocks(arg,3);
+  return NULL;
+}
+
+static void test_remote(void)
+{
+  struct blocks b;
+  pthread_t tid;
+
+  if (pthread_create(&tid,NULL,remote_owner,&b)) { fail("remote","cannot create thread",0,0); return; }
+  pthread_join(tid,NULL);
+}
+
+static void test_exit(unsigned int rounds)
+{
+  struct yal_stats st0,st1;
+  struct blocks b;
+  pthread_t tid;
+  unsigned int r;
+
+  yal_stats(&st0,1);
+  for (r = 0; r < rounds; r++) {
+    if (pthread_create(&tid,NULL,exit_child,&b)) { fail("exit","cannot create thread",r,0); return; }
+    pthread_join(tid,NULL);
+    free_blocks("exit",&b);
+  }
+  yal_stats(&st1,1);
+
+  if (st1.mmaplen != st0.mmaplen) fail("exit","mmap bytes not released",st1.mmaplen,st0.mmaplen);
+  if (st1.heaps > st0.heaps) fail("exit","heaps in use after their threads exited",st1.heaps,st0.heaps);
+}
+
+int main(int argc,char *argv[])
+{
+  unsigned int rounds = argc > 1 ? (unsigned int)strtoul(argv[1],NULL,10) : 64;
+
+  free(malloc(1)); // main thread heap
+
+  test_remote();
+  test_exit(rounds);
+
+  if (fails) fprintf(stderr,"%d checks failed\n",fails);
+  else printf("ok\n");
+  return fails != 0;
+}
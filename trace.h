@@ -0,0 +1,141 @@
+/* trace.h - binary per-thread event trace
+
+   This file is part of yalloc, yet another memory allocator with emphasis on efficiency and compactness.
+
+   SPDX-FileCopyrightText: © 2024 Joris van der Geer
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+  Events are stored as fixed-size records in a per-heap ring, written only by the owning thread.
+  Rings are drained to the trace file in bulk, either by the owner when 3/4 full, or by yal_trace_flush() from e.g. a flusher thread.
+  A per-ring flag makes draining exclusive. Records are lost, and counted, when a ring is full.
+  Records are rendered as text by the separate ytrace tool, and the standard interface calls replayed by yreplay.
+  YALLOC_TRACE=<file> starts tracing at the first heap, e.g. for a process running with the shared library preloaded.
+*/
+
+#define Tracelen (1u << Trace_ring)
+
+struct tracering {
+  _Atomic ub4 head; // written by owner
+  _Atomic ub4 tail; // written by drainer
+  _Atomic ub4 draining;
+  _Atomic ub4 drop;
+  struct tracerec recs[Tracelen];
+};
+
+static _Atomic int trace_fd = -1;
+
+static void trace_drain(heap *hb,struct tracering *rp)
+{
+  struct tracechunk ch;
+  const void *bufs[3];
+  size_t lens[3];
+  ub4 head,tail,cnt,pos,n1;
+  ub4 busy = 0;
+  int fd = atomic_load_explicit(&trace_fd,memory_order_relaxed);
+
+  if (fd < 0) return;
+  if (atomic_compare_exchange_strong(&rp->draining,&busy,1) == 0) return;
+
+  head = atomic_load_explicit(&rp->head,memory_order_acquire);
+  tail = atomic_load_explicit(&rp->tail,memory_order_relaxed);
+  cnt = head - tail;
+  if (cnt) {
+    pos = tail & (Tracelen - 1);
+    n1 = min(cnt,Tracelen - pos);
+    ch.magic = Trace_magic;
+    ch.heap = hb->id;
+    ch.cnt = cnt;
+    ch.drop = atomic_exchange_explicit(&rp->drop,0,memory_order_relaxed);
+    bufs[0] = &ch; lens[0] = sizeof(ch);
+    bufs[1] = rp->recs + pos; lens[1] = n1 * sizeof(struct tracerec);
+    bufs[2] = rp->recs; lens[2] = (cnt - n1) * sizeof(struct tracerec);
+    oswritev(fd,bufs,lens,cnt > n1 ? 3 : 2);
+    atomic_store_explicit(&rp->tail,head,memory_order_release);
+  }
+  atomic_store_explicit(&rp->draining,0,memory_order_release);
+}
+
+static void trace_rec(ub4 line,enum File file,heap *hb,enum Tracop op,size_t len,const void *p,ub4 regid)
+{
+  struct tracering *rp = hb->tracering;
+  struct tracerec *rec;
+  ub4 head,tail;
+
+  if (unlikely(rp == nil)) {
+    if (hb->critical) return;
+    rp = osmmap(sizeof(struct tracering));
+    if (rp == nil) return;
+    hb->tracering = rp;
+  }
+  head = atomic_load_explicit(&rp->head,memory_order_relaxed);
+  tail = atomic_load_explicit(&rp->tail,memory_order_acquire);
+  if (head - tail >= Tracelen) {
+    atomic_fetch_add_explicit(&rp->drop,1,memory_order_relaxed);
+    return;
+  }
+  rec = rp->recs + (head & (Tracelen - 1));
+  rec->tsc = ytsc();
+  rec->ptr = (size_t)p;
+  rec->len = len;
+  rec->reg = regid;
+  rec->line = (ub2)line;
+  rec->file = (ub1)file;
+  rec->op = (ub1)op;
+  atomic_store_explicit(&rp->head,head + 1,memory_order_release);
+
+  if (unlikely(head - tail >= (Tracelen >> 2) * 3) && hb->critical == 0) trace_drain(hb,rp);
+}
+
+static heap *setupheap(void);
+
+// standard interface calls, for replay. arg is the alignment for aligned_alloc()
+// Sets up the heap if needed, e.g. for a thread whose first call is free()
+static void trace_api(ub4 line,enum Tracop op,size_t len,const void *p,ub4 arg)
+{
+  heap *hb = thread_heap;
+
+  if (unlikely(hb == nil || ((size_t)hb & 1))) {
+    hb = setupheap();
+    if (hb == nil) return; // within heap setup
+  }
+  trace_rec(line,Fstd,hb,op,len,p,arg);
+}
+
+// start tracing to fd, or stop if fd < 0
+int yal_trace(int fd)
+{
+  struct tracehdr th;
+  char names[256];
+  const void *bufs[2];
+  size_t lens[2];
+  ub4 f,pos = 0;
+
+  if (fd >= 0) {
+    for (f = 0; f < Fcount; f++) pos += mini_snprintf(names,pos,sizeof(names) - 1,"%s",fnames[f]) + 1;
+    th.magic = Trace_magic;
+    th.version = Trace_version;
+    th.filecnt = Fcount;
+    th.namelen = pos;
+    bufs[0] = &th; lens[0] = sizeof(th);
+    bufs[1] = names; lens[1] = pos;
+    if (oswritev(fd,bufs,lens,2) < 0) return -1;
+  } else yal_trace_flush();
+  atomic_store_explicit(&trace_fd,fd,memory_order_release);
+  return 0;
+}
+
+// drain all rings
+void yal_trace_flush(void)
+{
+  heap *hb;
+
+  for (hb = atomic_load_explicit(&heaplist,memory_order_acquire); hb; hb = hb->nxt) {
+    if (hb->tracering) trace_drain(hb,hb->tracering);
+  }
+}
+
+// complete a trace started from YALLOC_TRACE or yal_trace() at exit
+static Destructor void trace_exit(void)
+{
+  if (atomic_load_explicit(&trace_fd,memory_order_relaxed) >= 0) yal_trace_flush();
+}
@@ -0,0 +1,46 @@
+/* tracefmt.h - binary trace format, shared by yalloc and the ytrace decoder
+
+   This file is part of yalloc, yet another memory allocator with emphasis on efficiency and compactness.
+
+   SPDX-FileCopyrightText: © 2024 Joris van der Geer
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+  A trace file starts with a header, followed by the source file names as null-terminated strings.
+  Then follow chunks, each holding the records drained from one heap's ring at once.
+
+  Records Tmalloc .. Tfreecall are written at the standard interface and form the call stream for replay.
+  A realloc() is written as a 'from' record before and a 'to' record after the call. Frees are written before the call, allocs after.
+*/
+
+#define Trace_magic 0x43525459u // 'YTRC'
+#define Trace_version 2
+
+enum Tracop { Tnone,Tbump,Tbin,Tslabfast,Tslab,Tbuddy,Tmmap,Tfree,Trealloc,Tnewreg,Tdelreg,Tosmem,Tosunmem,
+  Tmalloc,Tcalloc,Taligned,Trealfrom,Trealto,Tfreecall,Tcount };
+
+static const char *tracopnames[Tcount] = { "none","alloc bump","alloc bin","alloc slab fast","alloc slab","alloc buddy","alloc mmap","free","realloc","new region","del region","osmem","osunmem",
+  "malloc","calloc","aligned_alloc","realloc from","realloc to","free call" };
+
+struct tracehdr {
+  ub4 magic;
+  ub4 version;
+  ub4 filecnt;
+  ub4 namelen; // total length of names following
+};
+
+struct tracechunk {
+  ub4 magic;
+  ub4 heap;
+  ub4 cnt;
+  ub4 drop; // records lost since previous chunk
+};
+
+struct tracerec { // 32 bytes
+  ub8 tsc;
+  ub8 ptr;
+  ub8 len;
+  ub4 reg;
+  ub2 line;
+  ub1 file;
+  ub1 op;
+};
@@ -33,11 +33,15 @@
 #include <stddef.h> // size_t,max_align_t
 #include <stdint.h> // SIZE_MAX
 #include <string.h> // memset
+#include <stdio.h> // FILE for malloc_info
+#include <pthread.h> // thread exit hook
 
 #include "stdlib.h"
 #include "config.h"
 #include "malloc.h"
 
+#include "yalloc.h"
+
 #ifdef VALGRIND
  #include <valgrind/valgrind.h>
  #include <valgrind/memcheck.h>
@@ -80,8 +84,12 @@ struct st_region { // 5b
   ub4 celcnt;
 
   ub4 ofs;
+  ub4 zerofrom; // user bytes from here on not handed out since mapped, thus known zero. hi32 if unknown
+
+  _Atomic(struct st_heap *) owner; // for frees from other threads, found via the global directory
 
   ub2 clas;
+  ub2 node; // numa node of user and meta
   ub1 minorder; // buddy: granularity
   ub1 celord;  //   slab: cel len if pwr2
   ub1 cntord;
@@ -107,6 +115,13 @@ struct binentry2 { // idem, buddy
   size_t len;
 };
 
+struct profent { // heap profiler sample
+  size_t ip;
+  size_t len;
+  ub4 depth;
+  void *pcs[Prof_depth];
+};
+
 // main thread heap base including starter kit
 struct st_heap { // 4.5k
 
@@ -121,6 +136,7 @@ struct st_heap { // 4.5k
   ub2 tclas2clas[Maxtclass];
   ub2 clas2len[Maxclass];
   ub2 clascnt;
+  ub2 cal2clas[Calencnt]; // direct, for compile-time class indices
 
   region *clasreg[Maxclass];
 
@@ -139,6 +155,8 @@ struct st_heap { // 4.5k
   // region bases
   region *regmem;
   ub4 regmem_pos,regmem_top;
+  region *regini; // initial pool in heap base
+  ub4 reginitop;
   ub4 allocregcnt,freeregcnt;
   region *freereg;
   region *nxtregs;
@@ -153,22 +171,72 @@ struct st_heap { // 4.5k
 
   // boot mem
   ub4 inipos;
+  ub4 bumpcnt; // live blocks, see newheap()
   char  *inimem;
 
+  // mmap blocks
+  size_t mmap_threshold; // adaptive
+  struct mmapcache { // released blocks, mru first
+    void *p;
+    size_t len;
+  } mmcache[Mmap_cache];
+  ub4 mmcachecnt;
+  size_t mmcachelen;
+
   region *lastreg;
   void *lastptr;
   size_t lastlen;
 
   bool iniheap;
 
+  ub4 numanode; // regions are bound to this node in numa mode
+
+  // latency-critical mode: no os calls
+  bool critical;
+  size_t critfails; // os calls attempted while critical, regardless of Yal_enable_stats
+  ub4 critdefcnt;
+  struct critdefer {
+    void *p;
+    size_t len;
+  } critdefer[Crit_defer];
+
+  ub4 latpath; // slowest path of the current call
+
+  // blocks freed by other threads, pushed lock-free and drained by the owner
+  _Atomic(void *) remote; // linked through the block
+  _Atomic(void *) remotetiny; // 2- and 4-byte cels, via a 16-byte node from the freeing heap
+
   // preserve state
   ub4 delcnt;
   ub4 baselen;
 
   ub4 id; // ident
+
+  // kept across heap reuse. Single writer, read by yal_stats()
+  struct yal_stats stat;
+
+  struct st_heap *nxt; // list of all heaps
+  _Atomic ub4 inuse; // enum Heapuse
+
+  // heap profiler. table kept across heap reuse
+  sb8 profleft; // bytes until next sample
+  ub8 profrnd;
+  struct profent *proftab;
+  ub4 profcnt;
+
+  struct tracering *tracering; // kept across heap reuse
+
+#if Yal_enable_latency
+  size_t lathist[Yal_lat_count][Yal_lat_buckets]; // single writer, merged by yal_latency()
+#endif
 };
 typedef struct st_heap heap;
 
+// free: deleted and empty, reinitialised on reuse. orphan: thread exited, adopted as is. drain: orphan locked by a remote free
+enum Heapuse { Heap_free,Heap_inuse,Heap_orphan,Heap_drain };
+
+static _Atomic(heap *) heaplist; // heap bases are never unmapped, deleted ones are reused
+
 // per-thread heap base
 // delcnt if bit 0 set
 static _Thread_local heap *thread_heap = nil;
@@ -201,25 +269,50 @@ static int diag_fd = 2;
 #include "printf.h"
 #include "diag.h"
 
+#if Yal_enable_trace
+ #include "tracefmt.h"
+ #include "trace.h"
+#endif
+
+#include "copy.h"
+
 static void trimbin(heap *hb,bool full);
 
+static void mmap_cache_trim(heap *hb);
+static void remote_drain(heap *hb);
+static void orphan_drain(heap *xb);
+static void heap_exit(void *arg);
+
 static void ytrim(void)
 {
   heap *hb = thread_heap;
 
-  if (hb) trimbin(hb,1);
+  if (hb == nil || ((size_t)hb & 1)) return;
+  mmap_cache_trim(hb);
+  trimbin(hb,1);
 }
 
 // Get chunk of memory from the O.S. Trim heap if needed
 static void *osmem(ub4 line,enum File file,heap *hb,size_t len,cchar *desc)
 {
-    void *p = osmmap(len);
+    void *p;
+
+    if (unlikely(hb->critical)) { // forbidden
+      hb->critfails++;
+      ylog(Fyalloc,"heap %u osmem %zu`b for %s in critical mode",hb->id,len,desc);
+      return nil;
+    }
 
-    do_ylog(line,file,"heap %u",hb->id);
+    p = osmmap(len);
+    ystat(hb,oscalls)
+
+    ytracel(line,file,hb,Tosmem,len,p,0)
+    ylogl(line,file,"heap %u",hb->id)
     ylog(Fyalloc,"osmem %zu`b for %s = %p",len,desc,p);
     if (p) return p;
     trimbin(hb,0);
     p = osmmap(len);
+    ystat(hb,oscalls)
     if (p) return p;
     error(line,file,"heap %u oom for %zu`b",hb->id,len);
     return p;
@@ -227,24 +320,65 @@ static void *osmem(ub4 line,enum File file,heap *hb,size_t len,cchar *desc)
 
 static void osunmem(ub4 line,enum File file,heap *hb,void *p,size_t len,cchar *desc)
 {
-  do_ylog(line,file,"heap %u",hb->id);
+  ub4 pos;
+
+  if (unlikely(hb->critical)) { // defer until released
+    pos = hb->critdefcnt;
+    if (pos < Crit_defer) {
+      hb->critdefer[pos].p = p;
+      hb->critdefer[pos].len = len;
+      hb->critdefcnt = pos + 1;
+      return;
+    }
+    hb->critfails++;
+  }
+  ytracel(line,file,hb,Tosunmem,len,p,0)
+  ylogl(line,file,"heap %u",hb->id)
   ylog(Fyalloc,"osunmem %zu`b for %s = %p",len,desc,p);
+  ystat(hb,oscalls)
   osmunmap(p,len);
 }
 
+// mremap is an os call too: refused in critical mode
+static bool oscritical(ub4 line,enum File file,heap *hb,size_t len,cchar *desc)
+{
+  if (likely(hb->critical == 0)) return 0;
+  hb->critfails++;
+  ylogl(line,file,"heap %u",hb->id)
+  ylog(Fyalloc,"heap %u %s %zu`b in critical mode",hb->id,desc,len);
+  return 1;
+}
+
+#include "conf.h"
+#include "globdir.h"
 #include "heap.h"
 
+#include "mmap.h"
 #include "region.h"
 
 #include "buddy.h"
 #include "slab.h"
 
+#if Yal_enable_prof
+ #include "prof.h"
+#endif
+
 #include "alloc.h"
 #include "free.h"
 #include "realloc.h"
 
 #include "std.h"
 
+#if Yal_enable_numa
+ #include "numa.h"
+#endif
+#include "reserve.h"
+
+#if Yal_enable_stats
+ #include "stats.h"
+#endif
+#include "frag.h"
+
 // --- optional ---
 
 #ifdef Y_enable_boot_malloc
@@ -276,8 +410,15 @@ void *bootstrap_calloc(size_t num, size_t size)
 #ifdef Y_enable_mallopt
 int mallopt(int param, int value)
 {
+  size_t val = (size_t)value;
+
+  if (value < 0) return 0;
+  yal_conf(); // explicit settings take precedence over environment
+
   switch (param) {
-  case M_MMAP_THRESHOLD:
+  case M_MMAP_THRESHOLD: return setconf(Cmmap_threshold,val);
+  case M_TRIM_THRESHOLD: return setconf(Ctrim_threshold,val);
+  case M_ARENA_MAX: return 1; // heaps are per thread
   default: break;
   }
   return 0;
@@ -285,23 +426,46 @@ int mallopt(int param, int value)
 #endif
 
 #ifdef Y_enable_mallinfo
-struct mallinfo mallinfo(void)
+// yalloc does not track live bytes. 'in use' is reported as mapped bytes, 'free' as cached mmap blocks
+// keepcost is 0, as there is no top of heap as in glibc
+struct mallinfo2 mallinfo2(void)
 {
-  static struct mallinfo mi;
-
-  return &mi;
+  struct mallinfo2 mi;
+  struct yal_stats st;
+
+  yal_stats(&st,1);
+  memset(&mi,0,sizeof(mi));
+
+  mi.arena = st.mapuser - st.mmaplen - st.mmcachelen;
+  mi.hblks = st.mmap - st.freemmap;
+  mi.hblkhd = st.mmaplen;
+  mi.uordblks = st.mapuser - st.mmcachelen;
+  mi.fordblks = st.mmcachelen;
+  return mi;
 }
 
-struct mallinfo2 mallinfo2(void)
+struct mallinfo mallinfo(void)
 {
-  static struct mallinfo2 mi;
-
-  return &mi;
+  struct mallinfo2 mi2 = mallinfo2();
+  struct mallinfo mi;
+
+  mi.arena = (int)mi2.arena;
+  mi.ordblks = (int)mi2.ordblks;
+  mi.smblks = (int)mi2.smblks;
+  mi.hblks = (int)mi2.hblks;
+  mi.hblkhd = (int)mi2.hblkhd;
+  mi.usmblks = (int)mi2.usmblks;
+  mi.fsmblks = (int)mi2.fsmblks;
+  mi.uordblks = (int)mi2.uordblks;
+  mi.fordblks = (int)mi2.fordblks;
+  mi.keepcost = (int)mi2.keepcost;
+  return mi;
 }
 
-int malloc_info(int options, void *stream)
+int malloc_info(int options,FILE *fp)
 {
-  return 0;
+  if (options) return -1; // as glibc
+  return heapinfo(fp);
 }
 #endif
 
@@ -316,10 +480,11 @@ int malloc_trim(size_t pad)
 #ifdef Y_enable_glibc_malloc_stats
 void malloc_stats(void)
 {
+  heapstats();
 }
 #endif
 
-#if Yal_glibc_mtrace
+#ifdef Yal_glibc_mtrace
 void mtrace(void)
 {
   ylog(Fyalloc,"region %zu`b heap %zu`b",sizeof(struct st_region),sizeof(struct st_heap));
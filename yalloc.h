@@ -0,0 +1,121 @@
+/* yalloc.h - yalloc extensions to the standard malloc interface
+
+   This file is part of yalloc, yet another memory allocator with emphasis on efficiency and compactness.
+
+   SPDX-FileCopyrightText: © 2024 Joris van der Geer
+   SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// symbol-prefixed build with -DYal_prefix, e.g. to run next to the system allocator
+#ifdef Yal_prefix
+extern void *yal_malloc(size_t n);
+extern void yal_free(void *p);
+extern void yal_free_sized(void *p,size_t n);
+extern void *yal_calloc(size_t count,size_t size);
+extern void *yal_realloc(void *p,size_t newlen);
+extern void *yal_aligned_alloc(size_t align,size_t size);
+extern void *yal_memalign(size_t align,size_t size);
+extern void *yal_valloc(size_t size);
+extern void *yal_pvalloc(size_t size);
+extern int yal_posix_memalign(void **memptr,size_t align,size_t size);
+extern void *yal_reallocarray(void *p,size_t count,size_t size);
+extern size_t yal_malloc_usable_size(void *p);
+#endif
+
+// size-returning malloc, *usable set to the usable length >= n. Cel and buddy slack are thus available without realloc
+extern void *yal_malloc_sized(size_t n,size_t *usable);
+
+// grow p in place to at least minlen, preferably maxlen, e.g. for containers that cannot relocate their elements
+// within cel or buddy slack, or by extending mmap blocks with mremap(2) without moving. returns usable length, 0 if not possible
+extern size_t yal_expand(void *p,size_t minlen,size_t maxlen);
+
+// C++ operator new and delete, see new.cpp
+extern void *yal_new(size_t len); // nil on failure
+extern void *yal_new_aligned(size_t align,size_t len);
+extern void yal_delete(void *p,size_t len); // len 0 if unknown
+
+// allocation with a precomputed size class index, for 0 < len < Yal_class_len
+#define Yal_class_len 4096
+#define Yal_sizeclass(n) ((n) <= 2 ? 2u : (n) <= 4 ? 4u : (n) <= 8 ? 8u : (n) <= 16 ? 16u : (unsigned int)(((n) + 15) >> 4) + 16u)
+extern void *yal_new_class(size_t len,unsigned int calen);
+
+// yal_alloc(n) resolves the class at compile time for constant n, otherwise as yal_new(). nil on failure. free() as usual
+#if defined __GNUC__ && !defined __cplusplus
+ #define yal_alloc(n) (__builtin_constant_p(n) && (n) > 0 && (n) < Yal_class_len ? yal_new_class((n),Yal_sizeclass(n)) : yal_new(n))
+#else
+ #define yal_alloc(n) yal_new(n)
+#endif
+
+// copy and zero fill as used by realloc and calloc. Non-temporal stores from the last-level cache size on
+extern void yal_copy(void *dst,const void *src,size_t len);
+extern void yal_zero(void *p,size_t len);
+
+// diagnostics
+extern unsigned int yal_log(const char *cats); // enable log categories e.g. "region,heap" or "all", "" for none. returns previous mask
+
+// numa
+extern void yal_numa(int on); // bind regions of new and current heap to their node
+extern int yal_numa_node(int node); // set node for the calling thread's heap if node >= 0. returns node
+extern void *yal_alloc_interleaved(size_t len); // interleaved over all nodes, e.g. for large shared tables. free() as usual
+
+// latency-critical
+#define Yal_reserve_mlock 0x80000000u // as class bit, lock reserved memory
+extern int yal_reserve(size_t bytes,unsigned int classes); // prefault a buddy region for 'bytes' and one slab per pwr2 class bit 3 .. 11. returns 0 on success
+extern size_t yal_critical(int on); // forbid os memory calls for the calling thread's heap until released. returns #violations
+
+// statistics, per heap. Counts are cumulative, map lengths current
+struct yal_stats {
+  size_t bump,binhit,slabfast,slabslow,buddy,mmap; // allocs per path
+  size_t mmcachehit,mmcachemiss;
+  size_t freebump,freeslab,freebuddy,freemmap; // frees per region type
+  size_t freeremote; // frees of blocks owned by another thread's heap
+  size_t binevict;
+  size_t newregs,delregs;
+  size_t mapuser,mapmeta; // bytes mapped
+  size_t mmaplen; // bytes in mmap blocks
+  size_t mmcachelen; // bytes in released mmap blocks kept
+  size_t mmap_threshold;
+  size_t critfails;
+  size_t oscalls; // mmap, munmap and mremap
+  size_t profsamples,profdrop;
+  size_t heaps;
+};
+
+extern void yal_stats(struct yal_stats *sp,int all); // calling thread's heap, or sum of all heaps
+
+// latency per path in tsc ticks, when built with Yal_enable_latency. A call counts under the slowest path it took
+enum yal_latpath { Yal_lat_bump,Yal_lat_bin,Yal_lat_slabfast,Yal_lat_slabsearch,Yal_lat_buddy,Yal_lat_newslab,Yal_lat_mmap,Yal_lat_free,Yal_lat_remote,Yal_lat_count };
+#define Yal_lat_buckets 32 // bucket b counts [2^b,2^(b+1)) ticks, the last one all above
+struct yal_latency {
+  unsigned long hist[Yal_lat_count][Yal_lat_buckets];
+};
+extern int yal_latency(struct yal_latency *lp,int all); // as yal_stats(). returns -1 if not built in
+
+// binary event trace, decode with ytrace
+extern int yal_trace(int fd); // start writing to fd, < 0 to stop
+extern void yal_trace_flush(void); // drain all per-thread rings, e.g. from a flusher thread
+
+// fragmentation and occupancy per region of the calling thread's heap
+struct yal_regreport {
+  unsigned int heap,reg;
+  unsigned char typ,order; // typ: 0 deleted with memory retained, 1 buddy, 3 slab, 4 mmap
+  unsigned short clas;
+  unsigned int cellen,cels,used; // buddy: granule len and count
+  unsigned int binheld; // cels in recycling bin, counted as used
+  unsigned int freepages;
+  unsigned int runs[8]; // free cel runs of length 1,2-3,4-7 .. 128+
+  unsigned long len,metalen;
+};
+extern int yal_frag_report(int binfd,int txtfd); // records to binfd and/or table to txtfd, -1 to omit. returns #regions
+
+// heap profiler
+extern void yal_prof(size_t rate); // sample every 'rate' bytes on average, 0 to stop
+extern int yal_prof_dump(int fd); // live samples in pprof heap profile format
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,139 @@
+/* yalloc.hpp - C++ allocator adapters
+
+   This file is part of yalloc, yet another memory allocator with emphasis on efficiency and compactness.
+
+   SPDX-FileCopyrightText: © 2024 Joris van der Geer
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+  yal::allocator<T> is a standard allocator for containers. Single-object allocations, i.e. nodes, have their size class
+  resolved at compile time and enter the bin and slab path directly. Deallocation passes the known length to the sized free.
+  yal::alloc<Len>() does the same for plain blocks.
+  yal::memory_resource is a std::pmr resource serving from the calling thread's heap.
+  Both are stateless and compare equal. Blocks may be freed from any thread.
+  Link with yalloc.o or a -DYal_prefix build. new.cpp is not needed.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+
+#include "yalloc.h"
+
+namespace yal {
+
+#if defined __cpp_consteval
+ #define Yal_consteval consteval
+#else
+ #define Yal_consteval constexpr
+#endif
+
+// size class index of len as Yal_sizeclass(), 0 if len is not served from size classes
+constexpr unsigned int sizeclass(std::size_t len) noexcept
+{
+  return len == 0 || len >= Yal_class_len ? 0 : Yal_sizeclass(len);
+}
+
+static_assert(sizeclass(1) == 2 && sizeclass(8) == 8 && sizeclass(17) == 18 && sizeclass(Yal_class_len - 1) == 272,"sizeclass");
+
+// as sizeclass(), guaranteed at compile time from C++20
+Yal_consteval unsigned int fixedclass(std::size_t len) noexcept
+{
+  return sizeclass(len);
+}
+
+constexpr std::size_t basealign = 16; // guaranteed by yal_new(), for all lengths
+
+inline void *allocate(std::size_t len,std::size_t align)
+{
+  void *p = align > basealign ? yal_new_aligned(align,len) : yal_new(len);
+
+  if (__builtin_expect(p == nullptr,0)) throw std::bad_alloc();
+  return p;
+}
+
+// single block of constant length, e.g. yal::alloc<sizeof(node)>(). free() or yal_delete() as usual
+template <std::size_t Len> inline void *alloc()
+{
+  constexpr unsigned int calen = fixedclass(Len);
+  void *p = calen ? yal_new_class(Len,calen) : yal_new(Len);
+
+  if (__builtin_expect(p == nullptr,0)) throw std::bad_alloc();
+  return p;
+}
+
+template <class T>
+class allocator {
+public:
+  typedef T value_type;
+
+  allocator() noexcept = default;
+  template <class U> allocator(const allocator<U> &) noexcept {}
+
+  T *allocate(std::size_t n)
+  {
+    constexpr unsigned int calen = fixedclass(sizeof(T));
+    void *p;
+
+    if (n == 1 && calen != 0 && alignof(T) <= basealign) {
+      p = yal_new_class(sizeof(T),calen);
+      if (__builtin_expect(p == nullptr,0)) throw std::bad_alloc();
+    } else {
+      if (n > static_cast<std::size_t>(-1) / sizeof(T)) throw std::bad_array_new_length();
+      p = yal::allocate(n * sizeof(T),alignof(T));
+    }
+    return static_cast<T *>(p);
+  }
+
+#if defined __cpp_lib_allocate_at_least
+  // the whole usable block, e.g. for vector growth into the size class slack
+  std::allocation_result<T *> allocate_at_least(std::size_t n)
+  {
+    std::size_t len;
+    void *p;
+
+    if (alignof(T) > basealign) return { allocate(n),n };
+    if (n > static_cast<std::size_t>(-1) / sizeof(T)) throw std::bad_array_new_length();
+    p = yal_malloc_sized(n * sizeof(T),&len);
+    if (__builtin_expect(p == nullptr,0)) throw std::bad_alloc();
+    return { static_cast<T *>(p),len / sizeof(T) };
+  }
+#endif
+
+  void deallocate(T *p,std::size_t n) noexcept
+  {
+    yal_delete(p,n * sizeof(T)); // also for aligned blocks, these are never offset
+  }
+
+  template <class U> bool operator==(const allocator<U> &) const noexcept { return true; }
+  template <class U> bool operator!=(const allocator<U> &) const noexcept { return false; }
+};
+
+class memory_resource : public std::pmr::memory_resource {
+protected:
+  void *do_allocate(std::size_t len,std::size_t align) override
+  {
+    return yal::allocate(len ? len : 1,align);
+  }
+
+  void do_deallocate(void *p,std::size_t len,std::size_t) override
+  {
+    yal_delete(p,len);
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+  {
+    return this == &other || dynamic_cast<const memory_resource *>(&other) != nullptr;
+  }
+};
+
+// process-wide instance, e.g. for std::pmr::set_default_resource()
+inline memory_resource *resource() noexcept
+{
+  static memory_resource res;
+
+  return &res;
+}
+
+} // namespace yal
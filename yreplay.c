@@ -0,0 +1,551 @@
+/* yreplay.c - replay the malloc() call stream of a binary yalloc trace
+
+   This file is part of yalloc, yet another memory allocator with emphasis on efficiency and compactness.
+
+   SPDX-FileCopyrightText: © 2024 Joris van der Geer
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   usage: yreplay [-a yalloc|libc] [-c] [-s] <trace file>
+   -a  - only run given allocator
+   -c  - csv output
+   -s  - serial: replay all calls from one thread
+
+   Capture with YALLOC_TRACE=<file>, e.g. with the shared library preloaded, or yal_trace()
+   Only the standard interface records are used, see tracefmt.h
+
+   Calls are sorted on their tsc into one global order. Each traced heap is replayed by a thread, reusing threads for heaps that do not overlap in time.
+   A turnstile lets exactly one call run at a time in global order. This preserves per-thread order and cross-thread frees, and makes the replay deterministic.
+   Trace pointers are resolved to object ids beforehand. Frees of blocks allocated before the trace started, or lost in a full ring, are skipped and counted.
+
+   Reported: time spent in the allocator, peak rss above the baseline before the replay, live bytes at that peak and the resulting overhead,
+   and for yalloc the allocation and free counts per path.
+*/
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "base.h"
+
+#include "tracefmt.h"
+
+#include "bench.h"
+
+enum Rop { Rmalloc,Rcalloc,Raligned,Rrealloc,Rfree };
+
+// as loaded
+struct lrec {
+  ub8 tsc;
+  ub8 ptr,nptr; // nptr for realloc
+  ub8 len;
+  ub4 heap;
+  ub4 arg;
+  ub4 seq;
+  ub1 op;
+};
+
+// as replayed
+struct rop {
+  size_t len;
+  ub4 id,oid; // oid: realloc source
+  ub4 arg;
+  ub1 op;
+};
+
+struct hstate { // per traced heap
+  ub8 first,last;
+  ub4 pend; // 1 + index of pending realloc from
+  ub4 thr;
+  bool seen;
+};
+
+struct rthread {
+  ub4 *idx; // global op indices
+  ub4 cnt,top;
+  ub8 last; // tsc of last call of the previous heap
+  ub8 ns;
+};
+
+static struct lrec *lrecs;
+static ub4 lcnt,ltop;
+
+static struct hstate *heaps;
+static ub4 heaptop;
+
+static struct rop *rops;
+static ub4 ropcnt;
+static ub4 *ropthr;
+
+static struct rthread *rthreads;
+static ub4 rthrcnt;
+
+static ub4 objcnt;
+static size_t skipcnt,dropcnt;
+
+static int _Printf(1,2) error(cchar *fmt,...)
+{
+  va_list ap;
+
+  va_start(ap,fmt);
+  vfprintf(stderr,fmt,ap);
+  va_end(ap);
+  fputc('\n',stderr);
+  return 1;
+}
+
+static void *xalloc(size_t n,size_t len)
+{
+  void *p = calloc(n ? n : 1,len);
+
+  if (p == nil) { error("out of memory for %zu * %zu",n,len); exit(1); }
+  return p;
+}
+
+static void *xrealloc(void *p,size_t n,size_t len)
+{
+  p = realloc(p,n * len);
+
+  if (p == nil) { error("out of memory for %zu * %zu",n,len); exit(1); }
+  return p;
+}
+
+static struct hstate *getheap(ub4 id)
+{
+  ub4 top = heaptop;
+
+  if (id >= top) {
+    heaptop = max(id + 1,top * 2);
+    heaps = xrealloc(heaps,heaptop,sizeof(struct hstate));
+    memset(heaps + top,0,(heaptop - top) * sizeof(struct hstate));
+  }
+  return heaps + id;
+}
+
+static void addrec(ub4 heap,const struct tracerec *rp)
+{
+  struct hstate *hp = getheap(heap);
+  struct lrec *lp;
+  ub1 op;
+
+  switch (rp->op) {
+  case Tmalloc: op = Rmalloc; break;
+  case Tcalloc: op = Rcalloc; break;
+  case Taligned: op = Raligned; break;
+  case Trealfrom: op = Rrealloc; break;
+  case Tfreecall: op = Rfree; break;
+  case Trealto:
+    if (hp->pend) lrecs[hp->pend - 1].nptr = rp->ptr;
+    hp->pend = 0;
+    return;
+  default: return;
+  }
+  hp->pend = 0;
+
+  if (lcnt == ltop) {
+    ltop = ltop ? ltop * 2 : 65536;
+    lrecs = xrealloc(lrecs,ltop,sizeof(struct lrec));
+  }
+  lp = lrecs + lcnt;
+  lp->tsc = rp->tsc;
+  lp->ptr = rp->ptr;
+  lp->nptr = 0;
+  lp->len = rp->len;
+  lp->heap = heap;
+  lp->arg = rp->reg;
+  lp->seq = lcnt;
+  lp->op = op;
+  if (op == Rrealloc) hp->pend = lcnt + 1;
+
+  if (hp->seen == 0) { hp->first = rp->tsc; hp->seen = 1; }
+  hp->last = rp->tsc;
+  lcnt++;
+}
+
+static int load(cchar *name)
+{
+  struct tracehdr th;
+  struct tracechunk ch;
+  struct tracerec rec;
+  char names[4096];
+  FILE *fp;
+  ub4 i;
+
+  fp = fopen(name,"rb");
+  if (!fp) return error("cannot open '%s': %m",name);
+
+  if (fread(&th,sizeof(th),1,fp) != 1 || th.magic != Trace_magic) return error("'%s' is not a yalloc trace",name);
+  if (th.version != Trace_version) return error("'%s' has version %u, expected %u",name,th.version,Trace_version);
+  if (th.namelen > sizeof(names) || fread(names,1,th.namelen,fp) != th.namelen) return error("'%s' has invalid header",name);
+
+  while (fread(&ch,sizeof(ch),1,fp) == 1) {
+    if (ch.magic != Trace_magic) return error("'%s' corrupt chunk after %u calls",name,lcnt);
+    dropcnt += ch.drop;
+    for (i = 0; i < ch.cnt; i++) {
+      if (fread(&rec,sizeof(rec),1,fp) != 1) return error("'%s' truncated after %u calls",name,lcnt);
+      addrec(ch.heap,&rec);
+    }
+  }
+  fclose(fp);
+  return 0;
+}
+
+static int cmprec(const void *a,const void *b)
+{
+  const struct lrec *x = a,*y = b;
+
+  if (x->tsc != y->tsc) return x->tsc < y->tsc ? -1 : 1;
+  return x->seq < y->seq ? -1 : 1;
+}
+
+// -- trace pointer to object id, open addressing with backward-shift delete --
+
+static ub8 *mapkeys;
+static ub4 *mapvals;
+static ub4 mapmsk;
+
+static ub4 maphash(ub8 k)
+{
+  return (ub4)((k * 0x9e3779b97f4a7c15ul) >> 32) & mapmsk;
+}
+
+static void mapput(ub8 key,ub4 val)
+{
+  ub4 h = maphash(key);
+
+  while (mapkeys[h] && mapkeys[h] != key) h = (h + 1) & mapmsk;
+  mapkeys[h] = key;
+  mapvals[h] = val;
+}
+
+// returns 1 + id, or 0 if absent
+static ub4 mapdel(ub8 key)
+{
+  ub4 h = maphash(key);
+  ub4 i,j,k;
+  ub4 val;
+
+  while (mapkeys[h] != key) {
+    if (mapkeys[h] == 0) return 0;
+    h = (h + 1) & mapmsk;
+  }
+  val = mapvals[h];
+  i = h;
+  j = i;
+  for (;;) {
+    j = (j + 1) & mapmsk;
+    if (mapkeys[j] == 0) break;
+    k = maphash(mapkeys[j]);
+    if ( (j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j)) ) {
+      mapkeys[i] = mapkeys[j];
+      mapvals[i] = mapvals[j];
+      i = j;
+    }
+  }
+  mapkeys[i] = 0;
+  return val + 1;
+}
+
+static void resolve(void)
+{
+  struct lrec *lp;
+  struct rop *rp;
+  ub4 n,i,id;
+
+  for (n = 2; n < lcnt * 2; n <<= 1) ;
+  mapmsk = n - 1;
+  mapkeys = xalloc(n,sizeof(ub8));
+  mapvals = xalloc(n,sizeof(ub4));
+
+  rops = xalloc(lcnt,sizeof(struct rop));
+  ropthr = xalloc(lcnt,sizeof(ub4));
+
+  for (i = 0; i < lcnt; i++) {
+    lp = lrecs + i;
+    rp = rops + ropcnt;
+    rp->op = lp->op;
+    rp->len = lp->len;
+    rp->arg = lp->arg;
+
+    switch (lp->op) {
+    case Rmalloc: case Rcalloc: case Raligned:
+      if (lp->ptr == 0) continue; // failed
+      rp->id = objcnt++;
+      mapput(lp->ptr,rp->id);
+      break;
+
+    case Rfree:
+      id = mapdel(lp->ptr);
+      if (id == 0) { skipcnt++; continue; }
+      rp->id = id - 1;
+      break;
+
+    case Rrealloc:
+      id = mapdel(lp->ptr);
+      if (lp->nptr == 0) { // failed or 'to' lost
+        if (id) mapput(lp->ptr,id - 1);
+        continue;
+      }
+      rp->id = objcnt++;
+      mapput(lp->nptr,rp->id);
+      if (id == 0) { rp->op = Rmalloc; skipcnt++; }
+      else rp->oid = id - 1;
+      break;
+    }
+    ropthr[ropcnt++] = getheap(lp->heap)->thr;
+  }
+  free(mapkeys);
+  free(mapvals);
+}
+
+// assign heaps to threads in order of first use, reusing a thread once its previous heap has ended
+static int cmpheap(const void *a,const void *b)
+{
+  const struct hstate *x = *(const struct hstate *const *)a,*y = *(const struct hstate *const *)b;
+
+  return x->first < y->first ? -1 : x->first > y->first;
+}
+
+static void assign(bool serial)
+{
+  struct hstate **order;
+  struct hstate *hp;
+  ub4 h,n = 0,t;
+
+  order = xalloc(heaptop,sizeof(void *));
+  for (h = 0; h < heaptop; h++) if (heaps[h].seen) order[n++] = heaps + h;
+  qsort(order,n,sizeof(void *),cmpheap);
+
+  rthreads = xalloc(max(n,1),sizeof(struct rthread));
+  for (h = 0; h < n; h++) {
+    hp = order[h];
+    for (t = 0; t < rthrcnt && serial == 0; t++) if (rthreads[t].last < hp->first) break;
+    if (t == rthrcnt) rthrcnt++;
+    rthreads[t].last = hp->last;
+    hp->thr = t;
+  }
+  free(order);
+}
+
+static void distribute(void)
+{
+  struct rthread *tp;
+  ub4 i,t;
+
+  for (i = 0; i < ropcnt; i++) rthreads[ropthr[i]].cnt++;
+  for (t = 0; t < rthrcnt; t++) rthreads[t].idx = xalloc(rthreads[t].cnt,sizeof(ub4));
+  for (i = 0; i < ropcnt; i++) {
+    tp = rthreads + ropthr[i];
+    tp->idx[tp->top++] = i;
+  }
+}
+
+// -- replay --
+
+#define Sample 65536 // rss sample interval in calls
+
+static const struct allocator *rap;
+static void **objs;
+static size_t *objlens;
+static _Atomic ub4 turn;
+
+static size_t live;
+static size_t baseline,peakrss,peaklive;
+static size_t peakmap;
+static long pagesize;
+
+static size_t rss(void)
+{
+  FILE *fp = fopen("/proc/self/statm","r");
+  unsigned long size = 0,res = 0;
+
+  if (fp == nil) return 0;
+  if (fscanf(fp,"%lu %lu",&size,&res) != 2) res = 0;
+  fclose(fp);
+  return res * (size_t)pagesize;
+}
+
+static void sample(void)
+{
+  struct yal_stats st;
+  size_t r = rss();
+
+  r = r > baseline ? r - baseline : 0;
+  if (r <= peakrss) return;
+  peakrss = r;
+  peaklive = live;
+  if (rap->malloc == yal_malloc) {
+    yal_stats(&st,1);
+    peakmap = st.mapuser;
+  }
+}
+
+// write one byte per page, as the traced program presumably did
+static void touch(char *p,size_t len)
+{
+  size_t i;
+
+  if (p == nil) return;
+  for (i = 0; i < len; i += (size_t)pagesize) p[i] = 1;
+}
+
+static ub8 exec(const struct rop *rp)
+{
+  const struct allocator *ap = rap;
+  size_t len = rp->len;
+  void *p = nil;
+  ub8 t0,t1;
+
+  t0 = nsnow();
+  switch (rp->op) {
+  case Rmalloc: p = ap->malloc(len); break;
+  case Rcalloc: p = ap->calloc(1,len); break;
+  case Raligned: p = ap->aligned_alloc(rp->arg,len); break;
+  case Rrealloc: p = ap->realloc(objs[rp->oid],len); break;
+  case Rfree: ap->free(objs[rp->id]); break;
+  }
+  t1 = nsnow();
+
+  if (rp->op == Rfree) {
+    objs[rp->id] = nil;
+    live -= objlens[rp->id];
+    return t1 - t0;
+  }
+  if (rp->op == Rrealloc) {
+    if (p == nil) { // block stays with the old id's successor
+      objs[rp->id] = objs[rp->oid];
+      objlens[rp->id] = objlens[rp->oid];
+      objs[rp->oid] = nil;
+      return t1 - t0;
+    }
+    objs[rp->oid] = nil;
+    live -= objlens[rp->oid];
+  }
+  objs[rp->id] = p;
+  if (p) {
+    objlens[rp->id] = len;
+    live += len;
+    touch(p,len);
+  }
+  return t1 - t0;
+}
+
+static void *replay_thread(void *arg)
+{
+  struct rthread *tp = arg;
+  ub4 i,idx,spin;
+
+  for (i = 0; i < tp->cnt; i++) {
+    idx = tp->idx[i];
+    spin = 0;
+    while (atomic_load_explicit(&turn,memory_order_acquire) != idx) {
+      if (++spin > 64) sched_yield();
+    }
+    tp->ns += exec(rops + idx);
+    if ( (idx & (Sample - 1)) == 0) sample();
+    atomic_store_explicit(&turn,idx + 1,memory_order_release);
+  }
+  return nil;
+}
+
+static int csv;
+
+static int replay(const struct allocator *ap)
+{
+  pthread_t *tids;
+  struct yal_stats st0,st1;
+  size_t ns = 0,i;
+  ub8 t0,wall;
+  ub4 t;
+
+  rap = ap;
+  objs = xalloc(objcnt,sizeof(void *));
+  objlens = xalloc(objcnt,sizeof(size_t));
+  tids = xalloc(rthrcnt,sizeof(pthread_t));
+  live = peakrss = peaklive = peakmap = 0;
+  atomic_store(&turn,0);
+  for (t = 0; t < rthrcnt; t++) rthreads[t].ns = 0;
+
+  yal_stats(&st0,1);
+  baseline = rss();
+  t0 = nsnow();
+
+  for (t = 0; t < rthrcnt; t++) {
+    if (pthread_create(tids + t,nil,replay_thread,rthreads + t)) return error("cannot create thread %u of %u: %m",t,rthrcnt);
+  }
+  for (t = 0; t < rthrcnt; t++) {
+    pthread_join(tids[t],nil);
+    ns += rthreads[t].ns;
+  }
+  wall = nsnow() - t0;
+  sample();
+  yal_stats(&st1,1);
+
+  for (i = 0; i < objcnt; i++) if (objs[i]) ap->free(objs[i]);
+  free(objs);
+  free(objlens);
+  free(tids);
+
+  double ovh = peakrss ? 100.0 * (double)(peakrss - min(peaklive,peakrss)) / (double)peakrss : 0;
+
+  if (csv) printf("%s,%u,%u,%zu,%zu,%zu,%zu,%.1f",ap->name,ropcnt,rthrcnt,ns,(size_t)wall,peakrss,peaklive,ovh);
+  else printf("%-8s %u calls %u threads  alloc %.3f s wall %.3f s  peak rss %zu KiB live %zu KiB overhead %.1f%%\n",
+    ap->name,ropcnt,rthrcnt,(double)ns / 1e9,(double)wall / 1e9,peakrss >> 10,peaklive >> 10,ovh);
+
+  if (ap->malloc == yal_malloc) {
+#define D(f) (st1.f - st0.f)
+    if (csv) printf(",%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu\n",peakmap,D(bump),D(binhit),D(slabfast),D(slabslow),D(buddy),D(mmap),
+      D(freebump),D(freeslab),D(freebuddy),D(freemmap),D(freeremote));
+    else printf("         mapped at peak %zu KiB\n         allocs bump %zu bin %zu slab %zu/%zu buddy %zu mmap %zu\n         frees  bump %zu slab %zu buddy %zu mmap %zu remote %zu\n",
+      peakmap >> 10,D(bump),D(binhit),D(slabfast),D(slabslow),D(buddy),D(mmap),D(freebump),D(freeslab),D(freebuddy),D(freemmap),D(freeremote));
+#undef D
+  } else if (csv) printf(",,,,,,,,,,,,\n");
+  fflush(stdout);
+  return 0;
+}
+
+static int usage(void)
+{
+  return error("usage: yreplay [-a yalloc|libc] [-c] [-s] <trace file>");
+}
+
+int main(int argc,char *argv[])
+{
+  cchar *only = nil;
+  bool serial = 0;
+  ub4 a;
+
+  pagesize = sysconf(_SC_PAGESIZE);
+
+  while (argc > 1 && argv[1][0] == '-') {
+    if (strcmp(argv[1],"-c") == 0) csv = 1;
+    else if (strcmp(argv[1],"-s") == 0) serial = 1;
+    else if (strcmp(argv[1],"-a") == 0 && argc > 2) { only = argv[2]; argc--; argv++; }
+    else return usage();
+    argc--; argv++;
+  }
+  if (argc != 2) return usage();
+
+  if (load(argv[1])) return 1;
+  qsort(lrecs,lcnt,sizeof(struct lrec),cmprec);
+  assign(serial);
+  resolve();
+  free(lrecs);
+  distribute();
+
+  fprintf(stderr,"%u calls, %u objects, %zu skipped, %zu records lost in trace\n",ropcnt,objcnt,skipcnt,dropcnt);
+
+  if (csv) printf("alloc,calls,threads,alloc_ns,wall_ns,peak_rss,peak_live,overhead_pct,peak_mapped,bump,bin,slabfast,slabslow,buddy,mmap,freebump,freeslab,freebuddy,freemmap,freeremote\n");
+
+  for (a = 0; a < Acnt; a++) {
+    if (only && strcmp(only,allocators[a].name)) continue;
+    if (replay(allocators + a)) return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,106 @@
+/* ytrace.c - decode a binary yalloc trace into the text log format
+
+   This file is part of yalloc, yet another memory allocator with emphasis on efficiency and compactness.
+
+   SPDX-FileCopyrightText: © 2024 Joris van der Geer
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   usage: ytrace [-t] <trace file>
+   -t  - prefix each line with the tsc delta from the first record
+*/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "base.h"
+
+#include "printf.h"
+
+#include "tracefmt.h"
+
+#define Maxfiles 64
+
+static cchar *filenames[Maxfiles];
+static char namebuf[4096];
+
+static int _Printf(2,3) error(ub4 line,cchar *fmt,...)
+{
+  va_list ap;
+  ub4 n = 0;
+  char buf[256];
+
+  if (line) n = mini_snprintf(buf,0,250,"Error ytrace.c:%u - ",line);
+
+  va_start(ap,fmt);
+  n += mini_vsnprintf(buf,n,250,fmt,ap);
+  va_end(ap);
+
+  buf[n++] = '\n';
+  fwrite(buf,1,n,stderr);
+  return 1;
+}
+
+static ub4 render(char *buf,ub4 len,ub4 heap,const struct tracerec *rp,ub8 tsc0,bool tsc)
+{
+  cchar *fname = rp->file < Maxfiles && filenames[rp->file] ? filenames[rp->file] : "?";
+  cchar *opname = rp->op < Tcount ? tracopnames[rp->op] : "?";
+  ub4 pos = 0;
+
+  if (tsc) pos = mini_snprintf(buf,0,len,"%12lu ",rp->tsc - tsc0);
+  pos += mini_snprintf(buf,pos,len,"%s:%u - heap %u %s %lu`b",fname,rp->line,heap,opname,rp->len);
+  if (rp->ptr) pos += mini_snprintf(buf,pos,len," = %lx",rp->ptr);
+  if (rp->op == Taligned) pos += mini_snprintf(buf,pos,len," align %u",rp->reg);
+  else if (rp->reg) pos += mini_snprintf(buf,pos,len," reg %u",rp->reg);
+  buf[pos++] = '\n';
+  return pos;
+}
+
+int main(int argc,char *argv[])
+{
+  struct tracehdr th;
+  struct tracechunk ch;
+  struct tracerec rec;
+  char buf[512];
+  cchar *name;
+  FILE *fp;
+  ub4 i,f,pos,n;
+  ub8 tsc0 = 0;
+  bool tsc = 0;
+  size_t reccnt = 0,dropcnt = 0;
+
+  if (argc > 1 && strcmp(argv[1],"-t") == 0) { tsc = 1; argc--; argv++; }
+  if (argc < 2) return error(0,"usage: ytrace [-t] <trace file>");
+
+  name = argv[1];
+  fp = fopen(name,"rb");
+  if (!fp) return error(__LINE__,"cannot open '%s': %m",name);
+
+  if (fread(&th,sizeof(th),1,fp) != 1 || th.magic != Trace_magic) return error(__LINE__,"'%s' is not a yalloc trace",name);
+  if (th.version != Trace_version) return error(__LINE__,"'%s' has version %u, expected %u",name,th.version,Trace_version);
+  if (th.namelen > sizeof(namebuf) || fread(namebuf,1,th.namelen,fp) != th.namelen) return error(__LINE__,"'%s' has invalid header",name);
+
+  for (f = 0, pos = 0; f < th.filecnt && f < Maxfiles && pos < th.namelen; f++) {
+    filenames[f] = namebuf + pos;
+    pos += (ub4)strlen(namebuf + pos) + 1;
+  }
+
+  while (fread(&ch,sizeof(ch),1,fp) == 1) {
+    if (ch.magic != Trace_magic) return error(__LINE__,"'%s' corrupt chunk after %zu records",name,reccnt);
+    if (ch.drop) {
+      n = mini_snprintf(buf,0,sizeof(buf),"heap %u lost %u records\n",ch.heap,ch.drop);
+      fwrite(buf,1,n,stdout);
+      dropcnt += ch.drop;
+    }
+    for (i = 0; i < ch.cnt; i++) {
+      if (fread(&rec,sizeof(rec),1,fp) != 1) return error(__LINE__,"'%s' truncated at %zu records",name,reccnt);
+      if (reccnt++ == 0) tsc0 = rec.tsc;
+      n = render(buf,sizeof(buf),ch.heap,&rec,tsc0,tsc);
+      fwrite(buf,1,n,stdout);
+    }
+  }
+  fclose(fp);
+  n = mini_snprintf(buf,0,sizeof(buf),"%zu records, %zu lost\n",reccnt,dropcnt);
+  fwrite(buf,1,n,stderr);
+  return 0;
+}